@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <cstddef>
+// Append-only storage made of fixed-size chunks. Elements never move once
+// constructed, so pointers into the arena stay valid for its whole
+// lifetime, and growing never copies existing elements. Everything is
+// destroyed and released at once when the arena goes away.
+template<typename T, size_t ChunkBits = 10>
+class ChunkedArena {
+private:
+    static const size_t ChunkSize = (size_t)1 << ChunkBits;
+    static const size_t ChunkMask = ChunkSize - 1;
+    std::vector<T*> chunks;
+    size_t count = 0;
+    void addChunk()
+    {
+        this->chunks.push_back(static_cast<T*>(::operator new(sizeof(T) * ChunkSize)));
+    }
+public:
+    ChunkedArena() {}
+    ChunkedArena(const ChunkedArena&) = delete;
+    ChunkedArena& operator=(const ChunkedArena&) = delete;
+    ~ChunkedArena()
+    {
+        this->clear();
+    }
+    template<typename... Args>
+    size_t emplace_back(Args&&... args)
+    {
+        size_t index = this->count;
+        if((index >> ChunkBits) == this->chunks.size()) this->addChunk();
+        new (&this->chunks[index >> ChunkBits][index & ChunkMask]) T(std::forward<Args>(args)...);
+        this->count++;
+        return index;
+    }
+    T& operator[](size_t index)
+    {
+        return this->chunks[index >> ChunkBits][index & ChunkMask];
+    }
+    const T& operator[](size_t index) const
+    {
+        return this->chunks[index >> ChunkBits][index & ChunkMask];
+    }
+    T& at(size_t index)
+    {
+        if(index >= this->count) throw std::out_of_range("ChunkedArena::at");
+        return (*this)[index];
+    }
+    size_t size() const
+    {
+        return this->count;
+    }
+    // Allocates the chunks for n elements up front.
+    void reserve(size_t n)
+    {
+        size_t needed = (n + ChunkMask) >> ChunkBits;
+        this->chunks.reserve(needed);
+        while(this->chunks.size() < needed) this->addChunk();
+    }
+    void clear()
+    {
+        for(size_t i = 0; i < this->count; i++) (*this)[i].~T();
+        for(T* chunk : this->chunks) ::operator delete(chunk);
+        this->chunks.clear();
+        this->count = 0;
+    }
+};
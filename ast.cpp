@@ -0,0 +1,853 @@
+#include "ast.hpp"
+#include "trace.hpp"
+#include <cmath>
+
+extern int yylineno;
+
+CompileError::CompileError(int line, const std::string& message) :
+    std::runtime_error(message),
+    line(line)
+{
+}
+int CompileError::getLine() const
+{
+    return this->line;
+}
+
+Ast* Ast::instance = nullptr;
+Ast::Ast()
+{
+    if(Ast::instance == nullptr)
+    {
+        Ast::instance = this;
+    }
+}
+Ast* Ast::getDefault()
+{
+    return Ast::instance;
+}
+void Ast::setDefault()
+{
+    Ast::instance = this;
+}
+Node& Ast::operator[](node_t n)
+{
+    return this->nodes[n];
+}
+size_t Ast::size() const
+{
+    return this->nodes.size();
+}
+node_t Ast::make(NodeKinds kind, node_t c0, node_t c1, node_t c2)
+{
+    if(this->nodes.size() >= NO_NODE) throw std::runtime_error("Program too large.");
+    return (node_t)this->nodes.emplace_back(Node{kind, VarTypes::VT_NOTYPE, 0, (uint32_t)yylineno, 0, {c0, c1, c2}, NO_NODE});
+}
+node_t Ast::symbol(size_t symbolIndex)
+{
+    node_t n = this->make(NodeKinds::NK_SYMBOL);
+    this->nodes[n].symbol = (uint32_t)symbolIndex;
+    return n;
+}
+node_t Ast::index(size_t arrayIndex, node_t indexExpression)
+{
+    node_t n = this->make(NodeKinds::NK_INDEX, indexExpression);
+    this->nodes[n].symbol = (uint32_t)arrayIndex;
+    return n;
+}
+node_t Ast::call(size_t symbolIndex, node_t arguments)
+{
+    node_t n = this->make(NodeKinds::NK_CALL, arguments);
+    this->nodes[n].symbol = (uint32_t)symbolIndex;
+    return n;
+}
+node_t Ast::unary(NodeKinds kind, node_t child)
+{
+    return this->make(kind, child);
+}
+node_t Ast::binary(NodeKinds kind, address_t op, node_t lhs, node_t rhs)
+{
+    node_t n = this->make(kind, lhs, rhs);
+    this->nodes[n].op = (uint16_t)op;
+    return n;
+}
+node_t Ast::assign(node_t target, node_t value)
+{
+    return this->make(NodeKinds::NK_ASSIGN, target, value);
+}
+node_t Ast::ifElse(node_t condition, node_t thenStatement, node_t elseStatement)
+{
+    return this->make(NodeKinds::NK_IF, condition, thenStatement, elseStatement);
+}
+node_t Ast::whileLoop(node_t condition, node_t body)
+{
+    return this->make(NodeKinds::NK_WHILE, condition, body);
+}
+node_t Ast::write(node_t expression)
+{
+    return this->make(NodeKinds::NK_WRITE, expression);
+}
+node_t Ast::list(NodeKinds kind, node_t first)
+{
+    return this->make(kind, first, first);
+}
+node_t Ast::append(node_t list, node_t element)
+{
+    Node& l = this->nodes[list];
+    if(l.children[1] == NO_NODE) l.children[0] = element;
+    else this->nodes[l.children[1]].next = element;
+    l.children[1] = element;
+    return list;
+}
+// Puts a conversion node between a parent and one of its children.
+void Ast::wrap(node_t parent, int child, NodeKinds conversion)
+{
+    node_t converted = this->make(conversion, this->nodes[parent].children[child]);
+    Node& c = this->nodes[converted];
+    c.line = this->nodes[parent].line;
+    c.type = conversion == NodeKinds::NK_TOREAL ? VarTypes::VT_REAL : VarTypes::VT_INT;
+    this->nodes[parent].children[child] = converted;
+}
+
+// Source-like text of an expression, for error messages.
+void Ast::appendDescription(fmt::memory_buffer& out, node_t n)
+{
+    SymbolTable* st = SymbolTable::getDefault();
+    const Node& node = this->nodes[n];
+    switch(node.kind)
+    {
+        case NodeKinds::NK_SYMBOL:
+        case NodeKinds::NK_CALL:
+            st->appendDescriptor(out, node.symbol);
+        break;
+        case NodeKinds::NK_INDEX:
+            st->appendDescriptor(out, node.symbol);
+            out.push_back('[');
+            this->appendDescription(out, node.children[0]);
+            out.push_back(']');
+        break;
+        case NodeKinds::NK_NEGATE:
+            out.push_back('-');
+            this->appendDescription(out, node.children[0]);
+        break;
+        case NodeKinds::NK_BINARY:
+        case NodeKinds::NK_RELATION:
+            this->appendDescription(out, node.children[0]);
+            out.append(fmt::string_view(operatorTokenToString(node.op)));
+            this->appendDescription(out, node.children[1]);
+        break;
+        case NodeKinds::NK_NOT:
+            out.push_back('!');
+            this->appendDescription(out, node.children[0]);
+        break;
+        case NodeKinds::NK_TOREAL:
+            out.append(fmt::string_view("real("));
+            this->appendDescription(out, node.children[0]);
+            out.push_back(')');
+        break;
+        case NodeKinds::NK_TOINT:
+            out.append(fmt::string_view("int("));
+            this->appendDescription(out, node.children[0]);
+            out.push_back(')');
+        break;
+        default:
+            out.append(fmt::string_view("<STATEMENT>"));
+        break;
+    }
+}
+std::string Ast::describeOperation(node_t n)
+{
+    fmt::memory_buffer out;
+    this->appendDescription(out, n);
+    return fmt::to_string(out);
+}
+
+// Sets the type of every expression node and rejects ill-typed statements.
+VarTypes Ast::checkTypes(node_t n)
+{
+    SymbolTable* st = SymbolTable::getDefault();
+    Node& node = this->nodes[n];
+    VarTypes type = VarTypes::VT_NOTYPE;
+    switch(node.kind)
+    {
+        case NodeKinds::NK_SYMBOL:
+            type = st->at(node.symbol)->getVarType();
+        break;
+        case NodeKinds::NK_INDEX: {
+            VarTypes indexType = this->checkTypes(node.children[0]);
+            Symbol* array = st->at(node.symbol);
+            if(!array->isArray()) {
+                throw CompileError(node.line, fmt::format("{} is not an array.", st->getDescriptor(node.symbol)));
+            }
+            if(indexType != VarTypes::VT_INT) {
+                throw CompileError(node.line, fmt::format("Array index must be integer."));
+            }
+            type = array->getVarType();
+        }
+        break;
+        case NodeKinds::NK_CALL:
+            if(node.children[0] != NO_NODE) this->checkTypes(node.children[0]);
+            type = st->at(node.symbol)->getVarType();
+        break;
+        case NodeKinds::NK_LIST:
+        case NodeKinds::NK_BLOCK:
+            for(node_t element = node.children[0]; element != NO_NODE; element = this->nodes[element].next)
+            {
+                this->checkTypes(element);
+            }
+        break;
+        case NodeKinds::NK_NEGATE:
+            type = this->checkTypes(node.children[0]);
+        break;
+        case NodeKinds::NK_BINARY:
+        case NodeKinds::NK_RELATION: {
+            VarTypes lhs = this->checkTypes(node.children[0]);
+            VarTypes rhs = this->checkTypes(node.children[1]);
+            bool isResultReal = (lhs | rhs) & VarTypes::VT_REAL;
+            // a real operand only mixes with integers and reals, except that
+            // multiplicative operators have always let untyped operands through
+            Opcodes opcode = operatorTokenToOpcode(node.op);
+            bool multiplicative = opcode == Opcodes::OP_MUL || opcode == Opcodes::OP_DIV || opcode == Opcodes::OP_MOD;
+            if(isResultReal && !multiplicative && lhs != VarTypes::VT_INT && rhs != VarTypes::VT_INT && lhs != rhs) {
+                throw CompileError(node.line, fmt::format("Unknown type conversion in {}", this->describeOperation(n)));
+            }
+            if(node.kind == NodeKinds::NK_RELATION) type = VarTypes::VT_INT;
+            else type = isResultReal ? VarTypes::VT_REAL : VarTypes::VT_INT;
+        }
+        break;
+        case NodeKinds::NK_NOT:
+            this->checkTypes(node.children[0]);
+            type = VarTypes::VT_INT;
+        break;
+        case NodeKinds::NK_TOREAL:
+            type = VarTypes::VT_REAL;
+        break;
+        case NodeKinds::NK_TOINT:
+            type = VarTypes::VT_INT;
+        break;
+        case NodeKinds::NK_ASSIGN: {
+            VarTypes target = this->checkTypes(node.children[0]);
+            VarTypes value = this->checkTypes(node.children[1]);
+            bool converts = (target | value) == (VarTypes::VT_INT | VarTypes::VT_REAL);
+            if(!converts && target != value) {
+                throw CompileError(node.line,
+                    fmt::format("Types not set properly in assignment {}:={}",
+                        varTypeEnumToString(target), varTypeEnumToString(value)
+                    )
+                );
+            }
+        }
+        break;
+        case NodeKinds::NK_IF:
+            this->checkTypes(node.children[0]);
+            this->checkTypes(node.children[1]);
+            this->checkTypes(node.children[2]);
+        break;
+        case NodeKinds::NK_WHILE:
+            this->checkTypes(node.children[0]);
+            this->checkTypes(node.children[1]);
+        break;
+        case NodeKinds::NK_WRITE:
+            this->checkTypes(node.children[0]);
+        break;
+    }
+    node.type = (uint8_t)type;
+    return type;
+}
+
+// Makes every implicit int/real conversion an explicit node, so code
+// generation never looks at operand types.
+void Ast::insertConversions(node_t n)
+{
+    Node& node = this->nodes[n];
+    switch(node.kind)
+    {
+        case NodeKinds::NK_INDEX:
+        case NodeKinds::NK_NEGATE:
+        case NodeKinds::NK_WRITE:
+        case NodeKinds::NK_TOREAL:
+        case NodeKinds::NK_TOINT:
+            this->insertConversions(node.children[0]);
+        break;
+        case NodeKinds::NK_CALL:
+            if(node.children[0] != NO_NODE) this->insertConversions(node.children[0]);
+        break;
+        case NodeKinds::NK_LIST:
+        case NodeKinds::NK_BLOCK:
+            for(node_t element = node.children[0]; element != NO_NODE; element = this->nodes[element].next)
+            {
+                this->insertConversions(element);
+            }
+        break;
+        case NodeKinds::NK_BINARY:
+        case NodeKinds::NK_RELATION: {
+            this->insertConversions(node.children[0]);
+            this->insertConversions(node.children[1]);
+            VarTypes lhs = (VarTypes)this->nodes[node.children[0]].type;
+            VarTypes rhs = (VarTypes)this->nodes[node.children[1]].type;
+            if((lhs | rhs) & VarTypes::VT_REAL) {
+                if(lhs == VarTypes::VT_INT) this->wrap(n, 0, NodeKinds::NK_TOREAL);
+                else if(rhs == VarTypes::VT_INT) this->wrap(n, 1, NodeKinds::NK_TOREAL);
+            }
+        }
+        break;
+        case NodeKinds::NK_NOT:
+        case NodeKinds::NK_IF:
+        case NodeKinds::NK_WHILE:
+            for(int i = 0; i < 3 && node.children[i] != NO_NODE; i++)
+            {
+                this->insertConversions(node.children[i]);
+            }
+            if(this->nodes[node.children[0]].type == VarTypes::VT_REAL) this->wrap(n, 0, NodeKinds::NK_TOINT);
+        break;
+        case NodeKinds::NK_ASSIGN: {
+            this->insertConversions(node.children[0]);
+            this->insertConversions(node.children[1]);
+            VarTypes target = (VarTypes)this->nodes[node.children[0]].type;
+            VarTypes value = (VarTypes)this->nodes[node.children[1]].type;
+            if(target == VarTypes::VT_INT && value == VarTypes::VT_REAL) this->wrap(n, 1, NodeKinds::NK_TOINT);
+            else if(target == VarTypes::VT_REAL && value == VarTypes::VT_INT) this->wrap(n, 1, NodeKinds::NK_TOREAL);
+        }
+        break;
+        default:
+        break;
+    }
+}
+
+static bool fitsVmInteger(int64_t value)
+{
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+// The value of a constant operand, looking through conversions of
+// integer constants, which are exact.
+bool Ast::evaluateConstant(node_t n, ConstantValue& value)
+{
+    SymbolTable* st = SymbolTable::getDefault();
+    const Node& node = this->nodes[n];
+    if(node.kind == NodeKinds::NK_TOREAL) {
+        if(!this->evaluateConstant(node.children[0], value) || value.type != VarTypes::VT_INT) return false;
+        value.type = VarTypes::VT_REAL;
+        value.real = (double)value.integer;
+        return true;
+    }
+    if(node.kind != NodeKinds::NK_SYMBOL || st->at(node.symbol)->getSymbolType() != SymbolTypes::ST_NUM) return false;
+    value.type = st->at(node.symbol)->getVarType();
+    if(value.type == VarTypes::VT_INT) {
+        value.integer = st->getIntegerConstant(node.symbol);
+        return fitsVmInteger(value.integer);
+    }
+    value.real = st->getRealConstant(node.symbol);
+    return true;
+}
+// Computes an operation on constants the way the VM would at run time.
+// Declines whatever the VM does not define exactly: integer overflow,
+// division by zero, non-finite reals, real mod and logic on non-booleans.
+bool Ast::foldNode(const Node& node, ConstantValue& result)
+{
+    ConstantValue lhs, rhs;
+    if(!this->evaluateConstant(node.children[0], lhs)) return false;
+    if(node.kind == NodeKinds::NK_NEGATE) {
+        rhs = lhs;
+        lhs = ConstantValue{rhs.type, 0, 0.0};
+    }
+    else if(node.kind == NodeKinds::NK_NOT) {
+        if(lhs.type != VarTypes::VT_INT) return false;
+        result = ConstantValue{VarTypes::VT_INT, lhs.integer == 0 ? 1 : 0, 0.0};
+        return true;
+    }
+    else if(!this->evaluateConstant(node.children[1], rhs)) {
+        return false;
+    }
+    if(lhs.type != rhs.type) return false;
+    Opcodes opcode = node.kind == NodeKinds::NK_NEGATE ? Opcodes::OP_SUB : operatorTokenToOpcode(node.op);
+    if(lhs.type == VarTypes::VT_INT) {
+        int64_t a = lhs.integer;
+        int64_t b = rhs.integer;
+        int64_t r;
+        switch(opcode)
+        {
+            case Opcodes::OP_ADD: r = a + b; break;
+            case Opcodes::OP_SUB: r = a - b; break;
+            case Opcodes::OP_MUL: r = a * b; break;
+            case Opcodes::OP_DIV:
+                if(b == 0) return false;
+                r = a / b;
+            break;
+            case Opcodes::OP_MOD:
+                if(b == 0) return false;
+                r = a % b;
+            break;
+            case Opcodes::OP_AND:
+            case Opcodes::OP_OR:
+                if((a != 0 && a != 1) || (b != 0 && b != 1)) return false;
+                r = opcode == Opcodes::OP_AND ? (a & b) : (a | b);
+            break;
+            case Opcodes::OP_JE: r = a == b; break;
+            case Opcodes::OP_JNE: r = a != b; break;
+            case Opcodes::OP_JG: r = a > b; break;
+            case Opcodes::OP_JGE: r = a >= b; break;
+            case Opcodes::OP_JL: r = a < b; break;
+            case Opcodes::OP_JLE: r = a <= b; break;
+            default: return false;
+        }
+        if(!fitsVmInteger(r)) return false;
+        result = ConstantValue{VarTypes::VT_INT, r, 0.0};
+        return true;
+    }
+    if(lhs.type != VarTypes::VT_REAL) return false;
+    double a = lhs.real;
+    double b = rhs.real;
+    double r;
+    switch(opcode)
+    {
+        case Opcodes::OP_ADD: r = a + b; break;
+        case Opcodes::OP_SUB: r = a - b; break;
+        case Opcodes::OP_MUL: r = a * b; break;
+        case Opcodes::OP_DIV:
+            if(b == 0.0) return false;
+            r = a / b;
+        break;
+        case Opcodes::OP_JE: result = ConstantValue{VarTypes::VT_INT, a == b, 0.0}; return true;
+        case Opcodes::OP_JNE: result = ConstantValue{VarTypes::VT_INT, a != b, 0.0}; return true;
+        case Opcodes::OP_JG: result = ConstantValue{VarTypes::VT_INT, a > b, 0.0}; return true;
+        case Opcodes::OP_JGE: result = ConstantValue{VarTypes::VT_INT, a >= b, 0.0}; return true;
+        case Opcodes::OP_JL: result = ConstantValue{VarTypes::VT_INT, a < b, 0.0}; return true;
+        case Opcodes::OP_JLE: result = ConstantValue{VarTypes::VT_INT, a <= b, 0.0}; return true;
+        default: return false;
+    }
+    if(!std::isfinite(r)) return false;
+    result = ConstantValue{VarTypes::VT_REAL, 0, r};
+    return true;
+}
+// Turns a node into a constant-pool operand, dropping its operands.
+void Ast::setConstant(node_t n, const ConstantValue& value)
+{
+    SymbolTable* st = SymbolTable::getDefault();
+    Node& node = this->nodes[n];
+    node.kind = NodeKinds::NK_SYMBOL;
+    node.type = (uint8_t)value.type;
+    node.symbol = (uint32_t)(value.type == VarTypes::VT_INT ? st->insertOrGetIntegerConstant(value.integer) : st->insertOrGetRealConstant(value.real));
+    node.children[0] = node.children[1] = node.children[2] = NO_NODE;
+}
+// Replaces operations on constants by their value, which then goes to
+// the constant pool instead of taking a temporary and an instruction.
+void Ast::foldConstants(node_t n)
+{
+    Node& node = this->nodes[n];
+    switch(node.kind)
+    {
+        case NodeKinds::NK_SYMBOL:
+        break;
+        case NodeKinds::NK_LIST:
+        case NodeKinds::NK_BLOCK:
+            for(node_t element = node.children[0]; element != NO_NODE; element = this->nodes[element].next)
+            {
+                this->foldConstants(element);
+            }
+        break;
+        default:
+            for(int i = 0; i < 3; i++)
+            {
+                if(node.children[i] != NO_NODE) this->foldConstants(node.children[i]);
+            }
+        break;
+    }
+    if(node.kind != NodeKinds::NK_BINARY && node.kind != NodeKinds::NK_RELATION
+        && node.kind != NodeKinds::NK_NEGATE && node.kind != NodeKinds::NK_NOT) return;
+    ConstantValue value;
+    if(this->foldNode(node, value)) this->setConstant(n, value);
+}
+static bool isConstant(const ConstantValue& value, int64_t constant)
+{
+    return value.type == VarTypes::VT_INT ? value.integer == constant : value.real == (double)constant;
+}
+void Ast::replaceWithChild(node_t n, int child)
+{
+    uint32_t line = this->nodes[n].line;
+    node_t next = this->nodes[n].next;
+    this->nodes[n] = this->nodes[this->nodes[n].children[child]];
+    this->nodes[n].line = line;
+    this->nodes[n].next = next;
+}
+// (x+c1)+c2 becomes x+(c1+c2), likewise with subtractions, and
+// (x*c1)*c2 becomes x*(c1*c2). Integers only: 32-bit wrapping addition
+// and multiplication are associative, rounded real ones are not.
+bool Ast::reassociate(node_t n, Opcodes opcode, const ConstantValue& rhs)
+{
+    Node& node = this->nodes[n];
+    const Node& inner = this->nodes[node.children[0]];
+    ConstantValue innerConstant;
+    if(inner.kind != NodeKinds::NK_BINARY || inner.type != VarTypes::VT_INT) return false;
+    if(!this->evaluateConstant(inner.children[1], innerConstant) || innerConstant.type != VarTypes::VT_INT) return false;
+    Opcodes innerOpcode = operatorTokenToOpcode(inner.op);
+    int64_t combined;
+    if(opcode == Opcodes::OP_MUL && innerOpcode == Opcodes::OP_MUL) {
+        combined = innerConstant.integer * rhs.integer;
+    }
+    else if((opcode == Opcodes::OP_ADD || opcode == Opcodes::OP_SUB) && (innerOpcode == Opcodes::OP_ADD || innerOpcode == Opcodes::OP_SUB)) {
+        combined = (innerOpcode == Opcodes::OP_ADD ? innerConstant.integer : -innerConstant.integer)
+            + (opcode == Opcodes::OP_ADD ? rhs.integer : -rhs.integer);
+    }
+    else {
+        return false;
+    }
+    if(combined < INT32_MIN || combined > INT32_MAX) return false;
+    node_t constant = node.children[1];
+    node.children[0] = inner.children[0];
+    if(opcode != Opcodes::OP_MUL) {
+        // keep the constant positive, x-3 rather than x+-3, unless it has
+        // no positive counterpart in 32 bits
+        node.op = combined < 0 && combined != INT32_MIN ? '-' : '+';
+        if(node.op == '-') combined = -combined;
+    }
+    this->setConstant(constant, ConstantValue{VarTypes::VT_INT, combined, 0.0});
+    return true;
+}
+// Rewrites identities that hold exactly for the operand type, so that
+// each one saves an instruction and usually a temporary. Operands are
+// only dropped when they are plain symbols, whose evaluation has no
+// effect. Real identities are limited to the ones that are exact for
+// every double, -0.0, infinities and NaN included: x+0.0 is not.
+void Ast::simplify(node_t n)
+{
+    Node& node = this->nodes[n];
+    switch(node.kind)
+    {
+        case NodeKinds::NK_SYMBOL:
+        break;
+        case NodeKinds::NK_LIST:
+        case NodeKinds::NK_BLOCK:
+            for(node_t element = node.children[0]; element != NO_NODE; element = this->nodes[element].next)
+            {
+                this->simplify(element);
+            }
+        break;
+        default:
+            for(int i = 0; i < 3; i++)
+            {
+                if(node.children[i] != NO_NODE) this->simplify(node.children[i]);
+            }
+        break;
+    }
+    if(node.kind != NodeKinds::NK_BINARY) return;
+    // operands of another type are untyped, leave those alone
+    if(this->nodes[node.children[0]].type != node.type || this->nodes[node.children[1]].type != node.type) return;
+    Opcodes opcode = operatorTokenToOpcode(node.op);
+    bool integer = node.type == VarTypes::VT_INT;
+    ConstantValue lhs, rhs;
+    bool lhsConstant = this->evaluateConstant(node.children[0], lhs);
+    bool rhsConstant = this->evaluateConstant(node.children[1], rhs);
+    if(lhsConstant && !rhsConstant && (opcode == Opcodes::OP_ADD || opcode == Opcodes::OP_MUL)) {
+        std::swap(node.children[0], node.children[1]);
+        std::swap(lhs, rhs);
+        std::swap(lhsConstant, rhsConstant);
+    }
+    if(integer && rhsConstant && this->reassociate(n, opcode, rhs)) {
+        this->evaluateConstant(node.children[1], rhs);
+        opcode = operatorTokenToOpcode(node.op);
+    }
+    const Node& left = this->nodes[node.children[0]];
+    const Node& right = this->nodes[node.children[1]];
+    bool leftIsVariable = left.kind == NodeKinds::NK_SYMBOL && !lhsConstant;
+    if(opcode == Opcodes::OP_SUB && integer && leftIsVariable && right.kind == NodeKinds::NK_SYMBOL && right.symbol == left.symbol) {
+        this->setConstant(n, ConstantValue{VarTypes::VT_INT, 0, 0.0});
+        return;
+    }
+    if(!rhsConstant) return;
+    switch(opcode)
+    {
+        case Opcodes::OP_ADD:
+            if(integer && isConstant(rhs, 0)) this->replaceWithChild(n, 0);
+        break;
+        case Opcodes::OP_SUB:
+            if(isConstant(rhs, 0)) this->replaceWithChild(n, 0);
+        break;
+        case Opcodes::OP_MUL:
+            if(isConstant(rhs, 1)) {
+                this->replaceWithChild(n, 0);
+            }
+            else if(integer && isConstant(rhs, 0) && leftIsVariable) {
+                this->setConstant(n, rhs);
+            }
+        break;
+        case Opcodes::OP_DIV:
+            if(isConstant(rhs, 1)) this->replaceWithChild(n, 0);
+        break;
+        case Opcodes::OP_MOD:
+            if(integer && isConstant(rhs, 1) && leftIsVariable) {
+                this->setConstant(n, ConstantValue{VarTypes::VT_INT, 0, 0.0});
+            }
+        break;
+        default:
+        break;
+    }
+}
+// The operands of a binary operation are both evaluated before either of
+// them is converted.
+size_t Ast::generateOperand(node_t n)
+{
+    const Node& node = this->nodes[n];
+    if(node.kind == NodeKinds::NK_TOREAL || node.kind == NodeKinds::NK_TOINT) {
+        return this->generateExpression(node.children[0]);
+    }
+    return this->generateExpression(n);
+}
+size_t Ast::finishOperand(node_t n, size_t index)
+{
+    switch(this->nodes[n].kind)
+    {
+        case NodeKinds::NK_TOREAL:
+            return convertToReal(index);
+        case NodeKinds::NK_TOINT:
+            return convertToInt(index);
+        default:
+            return index;
+    }
+}
+// Records the code of an expression and returns the symbol holding its value.
+size_t Ast::generateExpression(node_t n)
+{
+    SymbolTable *st = SymbolTable::getDefault();
+    Emitter *e = Emitter::getDefault();
+    const Node node = this->nodes[n];
+    switch(node.kind)
+    {
+        case NodeKinds::NK_SYMBOL:
+            return node.symbol;
+        case NodeKinds::NK_CALL:
+            if(node.children[0] != NO_NODE) {
+                for(node_t argument = this->nodes[node.children[0]].children[0]; argument != NO_NODE; argument = this->nodes[argument].next)
+                {
+                    this->generateExpression(argument);
+                }
+            }
+            return node.symbol;
+        case NodeKinds::NK_INDEX: {
+            size_t expressionIndex = this->generateExpression(node.children[0]);
+            size_t arrayIndex = node.symbol;
+            Symbol* array = st->at(arrayIndex);
+            if(e->getOptimizationLevel() >= 1 && st->at(expressionIndex)->getSymbolType() == SymbolTypes::ST_NUM) {
+                // a constant index within the bounds addresses the element directly
+                int64_t element = st->getIntegerConstant(expressionIndex);
+                std::tuple<size_t, size_t> bounds = st->getArrayBounds(arrayIndex);
+                if(element >= (int64_t)std::get<0>(bounds) && element <= (int64_t)std::get<1>(bounds)) {
+                    address_t offset = (address_t)(element - std::get<0>(bounds)) * varTypeToSize(array->getVarType());
+                    return st->getArrayElement(arrayIndex, expressionIndex, array->getAddress() + offset);
+                }
+            }
+            st->releaseTemporary(expressionIndex);
+            size_t arrayIndexTemp = st->getNewTemporaryVariable(VarTypes::VT_INT);
+            st->setDescriptor(arrayIndexTemp, DescriptorKinds::DK_INDEX, arrayIndex, expressionIndex);
+            size_t arrayStart = std::get<0>(st->getArrayBounds(arrayIndex));
+            int varSize = varTypeToSize(array->getVarType());
+            std::string comment;
+            if(e->areCommentsEnabled()) {
+                comment = fmt::format("CALC_ARRAY_OFFSET({}-{})", st->getDescriptor(expressionIndex), arrayStart);
+            }
+            // from -O1 the subtraction of a zero lower bound and the addition of a zero base are left out
+            bool simplify = e->getOptimizationLevel() >= 1;
+            size_t offset = expressionIndex;
+            if(!simplify || arrayStart != 0) {
+                e->generateCode(Opcodes::OP_SUB, comment, expressionIndex, Immediate{(int64_t)arrayStart}, arrayIndexTemp);
+                offset = arrayIndexTemp;
+            }
+            if(e->areCommentsEnabled()) {
+                comment = fmt::format("CALC_ARRAY_OFFSET(({}-{})*{})", st->getDescriptor(expressionIndex), arrayStart, varSize);
+            }
+            e->generateCode(Opcodes::OP_MUL, comment, offset, Immediate{varSize}, arrayIndexTemp);
+            if(!simplify || array->getAddress() != 0) {
+                e->generateCode(Opcodes::OP_ADD, describe(arrayIndexTemp), arrayIndexTemp, Immediate{array->getAddress()}, arrayIndexTemp);
+            }
+            st->at(arrayIndexTemp)->setIsReference(true);
+            st->at(arrayIndexTemp)->setVarType(array->getVarType()); // change to double if needed
+            return arrayIndexTemp;
+        }
+        case NodeKinds::NK_NEGATE: {
+            size_t operand = this->generateExpression(node.children[0]);
+            Symbol* original = st->at(operand);
+            st->releaseTemporary(operand);
+            size_t negResult = st->getNewTemporaryVariable(original->getVarType());
+            e->subFromZero(operand, negResult);
+            return negResult;
+        }
+        case NodeKinds::NK_BINARY: {
+            ConstantValue value;
+            size_t lhs = this->generateOperand(node.children[0]);
+            size_t rhs = this->generateOperand(node.children[1]);
+            lhs = this->finishOperand(node.children[0], lhs);
+            rhs = this->finishOperand(node.children[1], rhs);
+            st->releaseTemporary(lhs);
+            st->releaseTemporary(rhs);
+            size_t opResult = st->getNewTemporaryVariable(node.type == VarTypes::VT_REAL ? VarTypes::VT_REAL : VarTypes::VT_INT);
+            st->setDescriptor(opResult, DescriptorKinds::DK_BINARY, lhs, rhs, operatorTokenToString(node.op));
+            Opcodes opcode = operatorTokenToOpcode(node.op);
+            if(opcode == Opcodes::OP_MUL && e->getOptimizationLevel() >= 1 && this->evaluateConstant(node.children[1], value) && isConstant(value, 2)) {
+                // the VM has no shift, doubling by an add is exact and no longer than the mul
+                e->generateCode(Opcodes::OP_ADD, describe(opResult), lhs, lhs, opResult);
+                return opResult;
+            }
+            e->generateCode(opcode, describe(opResult), lhs, rhs, opResult);
+            return opResult;
+        }
+        case NodeKinds::NK_RELATION: {
+            size_t lhs = this->generateOperand(node.children[0]);
+            size_t rhs = this->generateOperand(node.children[1]);
+            lhs = this->finishOperand(node.children[0], lhs);
+            rhs = this->finishOperand(node.children[1], rhs);
+            st->releaseTemporary(lhs);
+            st->releaseTemporary(rhs);
+            size_t opResultIndex = st->getNewTemporaryVariable(VarTypes::VT_INT);
+            st->setDescriptor(opResultIndex, DescriptorKinds::DK_BINARY, lhs, rhs, operatorTokenToString(node.op));
+            Label labelTrue = st->getNextLabelIndex(LabelKinds::LK_TRUE);
+            Label labelAfter = st->getNextLabelIndex(LabelKinds::LK_END);
+            e->generateCode(operatorTokenToOpcode(node.op), "", lhs, rhs, labelTrue);
+            e->generateCode(Opcodes::OP_MOV, "", Immediate{0}, opResultIndex);
+            e->generateJump(labelAfter);
+            e->generateLabel(labelTrue);
+            e->generateCode(Opcodes::OP_MOV, "", Immediate{1}, opResultIndex);
+            e->generateLabel(labelAfter);
+            return opResultIndex;
+        }
+        case NodeKinds::NK_NOT: {
+            size_t factorIndex = this->generateExpression(node.children[0]);
+            st->releaseTemporary(factorIndex);
+            size_t opResultIndex = st->getNewTemporaryVariable(VarTypes::VT_INT);
+            st->setDescriptor(opResultIndex, DescriptorKinds::DK_NOT, factorIndex);
+            Label labelTrue = st->getNextLabelIndex(LabelKinds::LK_TOTRUE);
+            Label labelAfter = st->getNextLabelIndex(LabelKinds::LK_END);
+            e->generateCode(Opcodes::OP_JE, "", factorIndex, Immediate{0}, labelTrue);
+            e->generateCode(Opcodes::OP_MOV, "", Immediate{0}, opResultIndex);
+            e->generateJump(labelAfter);
+            e->generateLabel(labelTrue);
+            e->generateCode(Opcodes::OP_MOV, "", Immediate{1}, opResultIndex);
+            e->generateLabel(labelAfter);
+            return opResultIndex;
+        }
+        case NodeKinds::NK_TOREAL:
+        case NodeKinds::NK_TOINT:
+            return this->finishOperand(n, this->generateExpression(node.children[0]));
+        default:
+            throw CompileError(node.line, "Statement used as an expression.");
+    }
+}
+void Ast::generateStatement(node_t n)
+{
+    SymbolTable *st = SymbolTable::getDefault();
+    Emitter *e = Emitter::getDefault();
+    const Node node = this->nodes[n];
+    switch(node.kind)
+    {
+        case NodeKinds::NK_ASSIGN: {
+            size_t varIndex = this->generateExpression(node.children[0]);
+            size_t exprIndex = this->generateExpression(node.children[1]);
+            std::string comment;
+            if(e->areCommentsEnabled()) {
+                comment = fmt::format("{}:={}", st->getDescriptor(varIndex), st->getDescriptor(exprIndex));
+            }
+            e->generateCode(Opcodes::OP_MOV, comment, exprIndex, varIndex);
+            st->releaseTemporary(exprIndex);
+            st->releaseTemporary(varIndex);
+        }
+        break;
+        case NodeKinds::NK_CALL:
+            this->generateExpression(n);
+        break;
+        case NodeKinds::NK_BLOCK:
+            for(node_t statement = node.children[0]; statement != NO_NODE; statement = this->nodes[statement].next)
+            {
+                this->generateStatement(statement);
+                st->releaseStatementTemporaries();
+                e->endStatement();
+            }
+        break;
+        case NodeKinds::NK_IF: {
+            size_t expressionIndex = this->generateExpression(node.children[0]);
+            Label labelElse = st->getNextLabelIndex(LabelKinds::LK_ELSE);
+            e->generateCode(Opcodes::OP_JE, "", expressionIndex, Immediate{0}, labelElse);
+            st->releaseTemporary(expressionIndex);
+            this->generateStatement(node.children[1]);
+            Label labelAfter = st->getNextLabelIndex(LabelKinds::LK_ENDIF);
+            e->generateJump(labelAfter);
+            e->generateLabel(labelElse);
+            this->generateStatement(node.children[2]);
+            e->generateLabel(labelAfter);
+        }
+        break;
+        case NodeKinds::NK_WHILE: {
+            size_t expressionIndex = this->generateExpression(node.children[0]);
+            Label labelEndWhile = st->getNextLabelIndex(LabelKinds::LK_ENDWHILE);
+            Label labelWhile = st->getNextLabelIndex(LabelKinds::LK_WHILE);
+            e->generateLabel(labelWhile);
+            e->generateCode(Opcodes::OP_JE, "", expressionIndex, Immediate{0}, labelEndWhile);
+            // the body must not reuse the slot the loop head tests
+            st->holdTemporary(expressionIndex);
+            this->generateStatement(node.children[1]);
+            e->generateJump(labelWhile);
+            e->generateLabel(labelEndWhile);
+            st->releaseHeldTemporary(expressionIndex);
+        }
+        break;
+        case NodeKinds::NK_WRITE: {
+            size_t expressionIndex = this->generateExpression(node.children[0]);
+            std::string comment;
+            if(e->areCommentsEnabled()) {
+                comment = fmt::format("write({})", st->getDescriptor(expressionIndex));
+            }
+            e->generateCode(Opcodes::OP_WRITE, comment, expressionIndex);
+            st->releaseTemporary(expressionIndex);
+        }
+        break;
+        default:
+            throw CompileError(node.line, "Expression used as a statement.");
+    }
+}
+void Ast::compile(node_t body)
+{
+    TRACE(TC_PARSER, TL_DEBUG, "Compiling {} AST nodes\n", this->nodes.size());
+    this->checkTypes(body);
+    this->insertConversions(body);
+    if(Emitter::getDefault()->getOptimizationLevel() >= 1) {
+        this->foldConstants(body);
+        this->simplify(body);
+    }
+    this->generateStatement(body);
+}
+
+std::string describe(size_t stIndex)
+{
+    if(!Emitter::getDefault()->areCommentsEnabled()) return "";
+    return SymbolTable::getDefault()->getDescriptor(stIndex);
+}
+size_t convertToReal(size_t stIndex, SymbolTable* st, Emitter * e)
+{
+    if(!e) e = Emitter::getDefault();
+    if(!st) st = SymbolTable::getDefault();
+    Symbol * toConvert = st->at(stIndex);
+    if(toConvert->getVarType() != VarTypes::VT_INT) throw std::runtime_error(fmt::format("Tried to convert nonint {} to real.", st->getAttribute(stIndex)));
+    if(e->getOptimizationLevel() >= 1 && toConvert->getSymbolType() == SymbolTypes::ST_NUM) {
+        int64_t value = st->getIntegerConstant(stIndex);
+        if(value >= INT32_MIN && value <= INT32_MAX) return st->insertOrGetRealConstant((double)value);
+    }
+    st->releaseTemporary(stIndex);
+    size_t convertedIndex = st->getNewTemporaryVariable(VarTypes::VT_REAL);
+    st->setDescriptor(convertedIndex, DescriptorKinds::DK_TOREAL, stIndex);
+    e->generateCode(Opcodes::OP_INTTOREAL, describe(convertedIndex), stIndex, convertedIndex);
+    return convertedIndex;
+}
+size_t convertToInt(size_t stIndex, SymbolTable* st, Emitter * e)
+{
+    if(!e) e = Emitter::getDefault();
+    if(!st) st = SymbolTable::getDefault();
+    Symbol * toConvert = st->at(stIndex);
+    if(toConvert->getVarType() != VarTypes::VT_REAL) throw std::runtime_error(fmt::format("Tried to convert nonreal {} to int.", st->getAttribute(stIndex)));
+    if(e->getOptimizationLevel() >= 1 && toConvert->getSymbolType() == SymbolTypes::ST_NUM) {
+        // only integral values, where truncating and rounding agree
+        double value = st->getRealConstant(stIndex);
+        if(value == std::trunc(value) && value >= INT32_MIN && value <= INT32_MAX) return st->insertOrGetIntegerConstant((int64_t)value);
+    }
+    st->releaseTemporary(stIndex);
+    size_t convertedIndex = st->getNewTemporaryVariable(VarTypes::VT_INT);
+    st->setDescriptor(convertedIndex, DescriptorKinds::DK_TOINT, stIndex);
+    e->generateCode(Opcodes::OP_REALTOINT, describe(convertedIndex), stIndex, convertedIndex);
+    return convertedIndex;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+#include <fmt/format.h>
+#include "arena.hpp"
+#include "vartypes.hpp"
+#include "bytecode.hpp"
+#include "symboltable.hpp"
+#include "emitter.hpp"
+// Syntax tree of the statements of one program or subprogram body. The
+// parser only builds it; type checking, conversion insertion and code
+// generation then run as separate passes over the whole body, with
+// constant folding and algebraic simplification in between from -O1.
+//
+// Nodes are 28-byte records in a chunked arena and refer to each other by
+// 32-bit indices. They are never freed one by one, the arena goes away
+// with the Ast at the end of the compilation.
+typedef uint32_t node_t;
+const node_t NO_NODE = UINT32_MAX;
+enum NodeKinds : uint8_t {
+    NK_SYMBOL = 0,  // variable or constant
+    NK_INDEX,       // symbol[children[0]]
+    NK_CALL,        // symbol(children[0]), arguments are evaluated and dropped
+    NK_LIST,        // children[0] first, children[1] last, linked by next
+    NK_NEGATE,      // -children[0]
+    NK_BINARY,      // children[0] op children[1]
+    NK_RELATION,    // children[0] op children[1], yields 0 or 1
+    NK_NOT,         // not children[0]
+    NK_TOREAL,      // inserted by the conversion pass
+    NK_TOINT,       // inserted by the conversion pass
+    NK_ASSIGN,      // children[0] := children[1]
+    NK_IF,          // if children[0] then children[1] else children[2]
+    NK_WHILE,       // while children[0] do children[1]
+    NK_WRITE,       // write(children[0])
+    NK_BLOCK        // statements, like NK_LIST
+};
+struct Node {
+    NodeKinds kind;
+    uint8_t type; // VarTypes, set by the type checking pass
+    uint16_t op; // operator token of NK_BINARY and NK_RELATION
+    uint32_t line;
+    uint32_t symbol;
+    node_t children[3];
+    node_t next; // following element of an NK_LIST or NK_BLOCK
+};
+static_assert(sizeof(Node) == 28, "AST nodes should stay 28 bytes");
+
+// Value of a constant operand while folding, in the VM's representation:
+// 32-bit integers and doubles.
+struct ConstantValue {
+    VarTypes type;
+    int64_t integer;
+    double real;
+};
+
+// An error found by one of the passes, reported at the line of the node.
+class CompileError : public std::runtime_error {
+private:
+    int line;
+public:
+    CompileError(int line, const std::string& message);
+    int getLine() const;
+};
+
+class Ast {
+private:
+    ChunkedArena<Node, 12> nodes;
+    static Ast* instance;
+    node_t make(NodeKinds kind, node_t c0=NO_NODE, node_t c1=NO_NODE, node_t c2=NO_NODE);
+    void wrap(node_t parent, int child, NodeKinds conversion);
+    void appendDescription(fmt::memory_buffer& out, node_t n);
+    std::string describeOperation(node_t n);
+    VarTypes checkTypes(node_t n);
+    void insertConversions(node_t n);
+    bool evaluateConstant(node_t n, ConstantValue& value);
+    bool foldNode(const Node& node, ConstantValue& result);
+    void setConstant(node_t n, const ConstantValue& value);
+    void foldConstants(node_t n);
+    void replaceWithChild(node_t n, int child);
+    bool reassociate(node_t n, Opcodes opcode, const ConstantValue& rhs);
+    void simplify(node_t n);
+    size_t generateOperand(node_t n);
+    size_t finishOperand(node_t n, size_t index);
+    size_t generateExpression(node_t n);
+    void generateStatement(node_t n);
+public:
+    Ast();
+    static Ast* getDefault();
+    void setDefault();
+    Node& operator[](node_t n);
+    size_t size() const;
+    node_t symbol(size_t symbolIndex);
+    node_t index(size_t arrayIndex, node_t indexExpression);
+    node_t call(size_t symbolIndex, node_t arguments=NO_NODE);
+    node_t unary(NodeKinds kind, node_t child);
+    node_t binary(NodeKinds kind, address_t op, node_t lhs, node_t rhs);
+    node_t assign(node_t target, node_t value);
+    node_t ifElse(node_t condition, node_t thenStatement, node_t elseStatement);
+    node_t whileLoop(node_t condition, node_t body);
+    node_t write(node_t expression);
+    // Lists start with their first element, append returns the list.
+    node_t list(NodeKinds kind, node_t first=NO_NODE);
+    node_t append(node_t list, node_t element);
+    // Runs the passes over a body and records its code in the emitter.
+    void compile(node_t body);
+};
+Opcodes operatorTokenToOpcode(address_t token);
+std::string describe(size_t stIndex);
+size_t convertToReal(size_t stIndex, SymbolTable* st=nullptr, Emitter * e=nullptr);
+size_t convertToInt(size_t stIndex, SymbolTable* st=nullptr, Emitter * e=nullptr);
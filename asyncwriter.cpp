@@ -0,0 +1,85 @@
+#include "asyncwriter.hpp"
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+// Spins briefly, then sleeps, so an idle side does not hold a core.
+static void backoff(unsigned& spins)
+{
+    if(++spins < 64) std::this_thread::yield();
+    else std::this_thread::sleep_for(std::chrono::microseconds(20));
+}
+
+AsyncWriter::AsyncWriter(int fd, size_t bufferSize) :
+    fd(fd)
+{
+    this->draining.reserve(bufferSize);
+    this->thread = std::thread(&AsyncWriter::run, this);
+}
+AsyncWriter::~AsyncWriter()
+{
+    if(this->thread.joinable()) {
+        this->stopping.store(true, std::memory_order_release);
+        this->thread.join();
+        ::close(this->fd);
+    }
+}
+void AsyncWriter::run()
+{
+    unsigned spins = 0;
+    while(true)
+    {
+        if(!this->busy.load(std::memory_order_acquire)) {
+            if(this->stopping.load(std::memory_order_acquire)) return;
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+        const char* data = this->draining.data();
+        size_t left = this->draining.size();
+        while(left > 0 && !this->error.load(std::memory_order_relaxed))
+        {
+            ssize_t written = write(this->fd, data, left);
+            if(written < 0) {
+                if(errno != EINTR) this->error.store(errno, std::memory_order_relaxed);
+                continue;
+            }
+            data += written;
+            left -= written;
+        }
+        this->busy.store(false, std::memory_order_release);
+    }
+}
+void AsyncWriter::waitUntilIdle()
+{
+    unsigned spins = 0;
+    while(this->busy.load(std::memory_order_acquire)) backoff(spins);
+}
+void AsyncWriter::checkError()
+{
+    int e = this->error.load(std::memory_order_relaxed);
+    if(e) throw std::runtime_error(fmt::format("Cannot write output: {}", std::strerror(e)));
+}
+void AsyncWriter::submit(fmt::memory_buffer& full)
+{
+    this->waitUntilIdle();
+    this->checkError();
+    // moving a heap-allocated memory_buffer only moves its pointer
+    fmt::memory_buffer written(std::move(this->draining));
+    this->draining = std::move(full);
+    full = std::move(written);
+    full.clear();
+    this->busy.store(true, std::memory_order_release);
+}
+void AsyncWriter::finish()
+{
+    if(!this->thread.joinable()) return;
+    this->waitUntilIdle();
+    this->stopping.store(true, std::memory_order_release);
+    this->thread.join();
+    ::close(this->fd);
+    this->checkError();
+}
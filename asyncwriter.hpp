@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <fmt/format.h>
+// Writes buffers to a file descriptor on a separate thread, so the
+// compiler keeps filling one buffer while the other is on its way to
+// disk. The two threads hand the buffer over through a single atomic
+// flag and never take a lock. The writer owns the descriptor and closes
+// it in finish().
+class AsyncWriter {
+private:
+    int fd;
+    std::thread thread;
+    fmt::memory_buffer draining;
+    // true while the writer owns draining
+    std::atomic<bool> busy{false};
+    std::atomic<bool> stopping{false};
+    std::atomic<int> error{0};
+    void run();
+    void waitUntilIdle();
+    void checkError();
+public:
+    AsyncWriter(int fd, size_t bufferSize);
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+    ~AsyncWriter();
+    // Takes the contents of full and leaves it empty, with the storage of
+    // the previously written buffer. Waits only if that one is still being
+    // written.
+    void submit(fmt::memory_buffer& full);
+    // Writes what is pending, stops the thread and closes the descriptor.
+    void finish();
+};
@@ -0,0 +1,179 @@
+#include "bytecode.hpp"
+#include "label.hpp"
+#include "constantpool.hpp"
+#include <fmt/compile.h>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+const char* opcodeToString(Opcodes op)
+{
+    static const char* names[OP_COUNT] = {
+        "jump", "mov", "add", "sub", "mul", "div", "mod", "and", "or",
+        "je", "jne", "jg", "jge", "jl", "jle",
+        "write", "inttoreal", "realtoint", "exit", "label", "nop"
+    };
+    return op < OP_COUNT ? names[op] : "<BADOP>";
+}
+int opcodeArity(Opcodes op)
+{
+    switch(op)
+    {
+        case Opcodes::OP_EXIT:
+        case Opcodes::OP_LABEL:
+        case Opcodes::OP_NOP:
+            return 0;
+        case Opcodes::OP_JUMP:
+        case Opcodes::OP_WRITE:
+            return 1;
+        case Opcodes::OP_MOV:
+        case Opcodes::OP_INTTOREAL:
+        case Opcodes::OP_REALTOINT:
+            return 2;
+        default:
+            return 3;
+    }
+}
+void appendVarint(fmt::memory_buffer& out, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+uint64_t zigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+int64_t zigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+namespace {
+class Reader {
+private:
+    const uint8_t* position;
+    const uint8_t* end;
+public:
+    Reader(const uint8_t* begin, const uint8_t* end) : position(begin), end(end) {}
+    bool atEnd() const
+    {
+        return this->position >= this->end;
+    }
+    const uint8_t* here() const
+    {
+        return this->position;
+    }
+    uint8_t byte()
+    {
+        if(this->atEnd()) throw std::runtime_error("Truncated bytecode.");
+        return *this->position++;
+    }
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for(unsigned shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t b = this->byte();
+            value |= (uint64_t)(b & 0x7f) << shift;
+            if(!(b & 0x80)) return value;
+        }
+        throw std::runtime_error("Malformed varint in bytecode.");
+    }
+    double real()
+    {
+        if(this->end - this->position < 8) throw std::runtime_error("Truncated bytecode.");
+        uint64_t bits = 0;
+        for(int i = 0; i < 8; i++) bits |= (uint64_t)this->position[i] << (8*i);
+        this->position += 8;
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+struct LabelDefinition {
+    Label label;
+    uint64_t offset;
+};
+}
+
+void disassemble(const uint8_t* data, size_t size, fmt::memory_buffer& out)
+{
+    if(size < sizeof(BYTECODE_MAGIC) + 4 || std::memcmp(data, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) != 0) {
+        throw std::runtime_error("Not a bytecode file.");
+    }
+    const uint8_t* code = data + sizeof(BYTECODE_MAGIC);
+    const uint8_t* trailerEnd = data + size - 4;
+    uint32_t codeSize = 0;
+    for(int i = 0; i < 4; i++) codeSize |= (uint32_t)trailerEnd[i] << (8*i);
+    if(codeSize > (size_t)(trailerEnd - code)) throw std::runtime_error("Bad code size in bytecode.");
+
+    Reader trailer(code + codeSize, trailerEnd);
+    std::vector<LabelDefinition> definitions(trailer.varint());
+    for(LabelDefinition& d : definitions)
+    {
+        d.label.index = (uint32_t)trailer.varint();
+        d.label.kind = (LabelKinds)trailer.byte();
+        d.offset = trailer.varint();
+    }
+    // label operands only carry the index, the kind comes from the table
+    std::vector<LabelKinds> kinds;
+    for(const LabelDefinition& d : definitions)
+    {
+        if(d.label.index >= kinds.size()) kinds.resize(d.label.index + 1, LabelKinds::LK_PLAIN);
+        kinds[d.label.index] = d.label.kind;
+    }
+
+    Reader reader(code, code + codeSize);
+    size_t nextDefinition = 0;
+    while(true)
+    {
+        uint64_t offset = reader.here() - code;
+        for(; nextDefinition < definitions.size() && definitions[nextDefinition].offset == offset; nextDefinition++)
+        {
+            Label label = definitions[nextDefinition].label;
+            fmt::format_to(fmt::appender(out), FMT_COMPILE("lab{}{}:\n"), label.index, labelKindToSuffix(label.kind));
+        }
+        if(reader.atEnd()) break;
+        uint8_t opcodeByte = reader.byte();
+        Opcodes op = (Opcodes)(opcodeByte & ~OPCODE_REAL_BIT);
+        if(op >= OP_LABEL) throw std::runtime_error(fmt::format("Bad opcode {} at offset {}.", opcodeByte, offset));
+        if(op == Opcodes::OP_EXIT) {
+            out.append(fmt::string_view("\texit;\n"));
+            continue;
+        }
+        fmt::format_to(fmt::appender(out), FMT_COMPILE("\t{}.{} "), opcodeToString(op), (opcodeByte & OPCODE_REAL_BIT) ? 'r' : 'i');
+        for(int i = 0; i < opcodeArity(op); i++)
+        {
+            if(i > 0) out.append(fmt::string_view(", "));
+            uint64_t operand = reader.varint();
+            uint64_t payload = operand >> OPERAND_TAG_BITS;
+            switch(operand & ((1 << OPERAND_TAG_BITS) - 1))
+            {
+                case OperandTags::OT_ADDRESS:
+                    fmt::format_to(fmt::appender(out), FMT_COMPILE("{}"), payload);
+                    break;
+                case OperandTags::OT_INDIRECT:
+                    fmt::format_to(fmt::appender(out), FMT_COMPILE("*{}"), payload);
+                    break;
+                case OperandTags::OT_IMMEDIATE:
+                    fmt::format_to(fmt::appender(out), FMT_COMPILE("#{}"), zigzagDecode(payload));
+                    break;
+                case OperandTags::OT_REAL:
+                    out.push_back('#');
+                    ConstantPool::appendRealSpelling(out, reader.real());
+                    break;
+                case OperandTags::OT_LABEL:
+                    if(payload >= kinds.size()) throw std::runtime_error(fmt::format("Undefined label {} at offset {}.", payload, offset));
+                    fmt::format_to(fmt::appender(out), FMT_COMPILE("#lab{}{}"), payload, labelKindToSuffix(kinds[payload]));
+                    break;
+                default:
+                    throw std::runtime_error(fmt::format("Bad operand tag at offset {}.", offset));
+            }
+        }
+        out.append(fmt::string_view(";\n"));
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <fmt/format.h>
+// Binary encoding of the instruction set written by --emit=bytecode.
+//
+//   "PBC1"                     magic
+//   instructions...            code, offsets below count from its start
+//   varint labelCount
+//   labelCount * { varint index, uint8 kind, varint offset }
+//   varint dataSize
+//   uint32 codeSize            little endian, the last four bytes
+//
+// An instruction is an opcode byte (OPCODE_REAL_BIT set for .r) followed
+// by opcodeArity() operands. An operand is a varint holding
+// payload << 3 | tag: a memory address, an indirect address, a zigzag
+// encoded integer immediate, or a label index resolved through the label
+// table at load time. Real immediates have no payload and are followed
+// by the 8 bytes of the double.
+enum Opcodes : uint8_t {
+    OP_JUMP = 0,
+    OP_MOV,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_AND,
+    OP_OR,
+    OP_JE,
+    OP_JNE,
+    OP_JG,
+    OP_JGE,
+    OP_JL,
+    OP_JLE,
+    OP_WRITE,
+    OP_INTTOREAL,
+    OP_REALTOINT,
+    OP_EXIT,
+    OP_LABEL, // IR only, defines a label and is never encoded
+    OP_NOP, // IR only, an instruction removed by an optimization pass
+    OP_COUNT
+};
+enum OperandTags : uint8_t {
+    OT_ADDRESS = 0,
+    OT_INDIRECT = 1,
+    OT_IMMEDIATE = 2,
+    OT_REAL = 3,
+    OT_LABEL = 4
+};
+const uint8_t OPCODE_REAL_BIT = 0x80;
+const unsigned OPERAND_TAG_BITS = 3;
+const char BYTECODE_MAGIC[4] = {'P', 'B', 'C', '1'};
+const char* opcodeToString(Opcodes op);
+int opcodeArity(Opcodes op);
+void appendVarint(fmt::memory_buffer& out, uint64_t value);
+uint64_t zigzagEncode(int64_t value);
+int64_t zigzagDecode(uint64_t value);
+// Writes the textual form of a bytecode file, as the compiler prints it
+// with --no-comments. Throws std::runtime_error on malformed input.
+void disassemble(const uint8_t* data, size_t size, fmt::memory_buffer& out);
@@ -0,0 +1,102 @@
+#include "constantpool.hpp"
+#include <fmt/format.h>
+#include <cstring>
+size_t ConstantPool::hash(VarTypes type, uint64_t bits)
+{
+    // splitmix64 finalizer
+    uint64_t h = bits + 0x9e3779b97f4a7c15ull * (uint64_t)type;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return (size_t)(h ^ (h >> 31));
+}
+uint64_t ConstantPool::bitsOf(const Constant& c)
+{
+    uint64_t bits;
+    if(c.type == VarTypes::VT_REAL) {
+        std::memcpy(&bits, &c.real, sizeof(bits));
+    }
+    else {
+        bits = (uint64_t)c.integer;
+    }
+    return bits;
+}
+constant_t ConstantPool::insertOrGet(const Constant& c, bool& inserted)
+{
+    uint64_t bits = ConstantPool::bitsOf(c);
+    size_t h = ConstantPool::hash(c.type, bits);
+    size_t position;
+    inserted = !this->index.find(h, [&](size_t i){
+        return this->constants[i].type == c.type && ConstantPool::bitsOf(this->constants[i]) == bits;
+    }, position);
+    if(inserted) {
+        position = this->constants.size();
+        this->constants.push_back(c);
+        this->constants.back().spelling = this->render(c);
+        this->index.insert(h, position);
+    }
+    return (constant_t)position;
+}
+constant_t ConstantPool::insertOrGetInteger(int64_t value, bool& inserted)
+{
+    Constant c;
+    c.type = VarTypes::VT_INT;
+    c.integer = value;
+    c.symbolIndex = (size_t)-1;
+    return this->insertOrGet(c, inserted);
+}
+constant_t ConstantPool::insertOrGetReal(double value, bool& inserted)
+{
+    Constant c;
+    c.type = VarTypes::VT_REAL;
+    c.real = value;
+    c.symbolIndex = (size_t)-1;
+    return this->insertOrGet(c, inserted);
+}
+VarTypes ConstantPool::getType(constant_t c) const
+{
+    return this->constants.at(c).type;
+}
+int64_t ConstantPool::getInteger(constant_t c) const
+{
+    const Constant& k = this->constants.at(c);
+    return k.type == VarTypes::VT_INT ? k.integer : (int64_t)k.real;
+}
+double ConstantPool::getReal(constant_t c) const
+{
+    const Constant& k = this->constants.at(c);
+    return k.type == VarTypes::VT_REAL ? k.real : (double)k.integer;
+}
+size_t ConstantPool::getSymbolIndex(constant_t c) const
+{
+    return this->constants.at(c).symbolIndex;
+}
+void ConstantPool::setSymbolIndex(constant_t c, size_t symbolIndex)
+{
+    this->constants.at(c).symbolIndex = symbolIndex;
+}
+atom_t ConstantPool::render(const Constant& c)
+{
+    fmt::memory_buffer out;
+    if(c.type == VarTypes::VT_INT) {
+        fmt::format_to(std::back_inserter(out), "{}", c.integer);
+    }
+    else {
+        ConstantPool::appendRealSpelling(out, c.real);
+    }
+    return this->spellings.intern(out.data(), out.size());
+}
+void ConstantPool::appendRealSpelling(fmt::memory_buffer& out, double value)
+{
+    size_t start = out.size();
+    fmt::format_to(fmt::appender(out), "{}", value);
+    std::string_view s(out.data()+start, out.size()-start);
+    if(s.find_first_of(".eEn") == std::string_view::npos) out.append(std::string_view(".0"));
+}
+std::string_view ConstantPool::getSpelling(constant_t c) const
+{
+    return this->spellings.view(this->constants.at(c).spelling);
+}
+size_t ConstantPool::size() const
+{
+    return this->constants.size();
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <fmt/format.h>
+#include "hashindex.hpp"
+#include "interner.hpp"
+#include "vartypes.hpp"
+typedef uint32_t constant_t;
+const constant_t NO_CONSTANT = UINT32_MAX;
+// Numeric literals, parsed once and deduplicated by type and value
+// (so 1.0 and 1.00 share an entry). Kept apart from the identifier
+// namespace; each entry remembers the symbol that stands for it and its
+// canonical spelling, rendered once on insertion.
+class ConstantPool {
+private:
+    struct Constant {
+        VarTypes type;
+        union {
+            int64_t integer;
+            double real;
+        };
+        size_t symbolIndex;
+        atom_t spelling;
+    };
+    std::vector<Constant> constants;
+    HashIndex index;
+    StringInterner spellings;
+    atom_t render(const Constant& c);
+    static size_t hash(VarTypes type, uint64_t bits);
+    static uint64_t bitsOf(const Constant& c);
+    constant_t insertOrGet(const Constant& c, bool& inserted);
+public:
+    constant_t insertOrGetInteger(int64_t value, bool& inserted);
+    constant_t insertOrGetReal(double value, bool& inserted);
+    VarTypes getType(constant_t c) const;
+    int64_t getInteger(constant_t c) const;
+    double getReal(constant_t c) const;
+    size_t getSymbolIndex(constant_t c) const;
+    void setSymbolIndex(constant_t c, size_t symbolIndex);
+    std::string_view getSpelling(constant_t c) const;
+    // Shortest round-trip form of a real, always spelled as a real literal.
+    static void appendRealSpelling(fmt::memory_buffer& out, double value);
+    size_t size() const;
+};
@@ -0,0 +1,30 @@
+#include "bytecode.hpp"
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <exception>
+
+// Prints the textual form of a bytecode file produced by comp --emit=bytecode.
+int main(int argc, char** argv)
+{
+    if(argc != 2) {
+        fmt::print(stderr, "usage: {} file.bc\n", argv[0]);
+        return 1;
+    }
+    std::ifstream input(argv[1], std::ios::binary);
+    if(!input) {
+        fmt::print(stderr, "cannot open {}\n", argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    fmt::memory_buffer out;
+    try {
+        disassemble(data.data(), data.size(), out);
+    } catch (const std::runtime_error& e) {
+        fmt::print(stderr, "{}: {}\n", argv[1], e.what());
+        return 1;
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}
@@ -1,171 +1,341 @@
 #include "emitter.hpp"
+#include "iropt.hpp"
+#include "trace.hpp"
 #include <fmt/format.h>
+#include <fmt/compile.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 
 Emitter* Emitter::instance = nullptr;
-Emitter::Emitter(std::string filename) :
-    outputFile(filename, std::fstream::out | std::fstream::trunc)
+Emitter::Emitter(int fd, size_t flushThreshold) :
+    outputFd(fd),
+    flushThreshold(flushThreshold)
 {
+    this->output.reserve(flushThreshold + 4096);
+    this->ir.reserve(IR_FLUSH_INSTRUCTIONS + 4096, flushThreshold + 4096);
     if (Emitter::instance == nullptr)
     {
         Emitter::instance = this;
     }
 }
+Emitter::Emitter(std::string filename, size_t flushThreshold) :
+    Emitter(Emitter::openOutput(filename), flushThreshold)
+{
+}
+int Emitter::openOutput(const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error(fmt::format("Cannot open {}: {}", filename, std::strerror(errno)));
+    }
+    return fd;
+}
+Emitter::~Emitter()
+{
+    this->close();
+}
+void Emitter::flush()
+{
+    if(this->writer) {
+        if(this->output.size() == 0) return;
+        this->flushedBytes += this->output.size();
+        this->writer->submit(this->output);
+        return;
+    }
+    const char* data = this->output.data();
+    size_t left = this->output.size();
+    while(left > 0)
+    {
+        ssize_t written = write(this->outputFd, data, left);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            throw std::runtime_error(fmt::format("Cannot write output: {}", std::strerror(errno)));
+        }
+        data += written;
+        left -= written;
+        this->flushedBytes += written;
+    }
+    this->output.clear();
+}
+void Emitter::flushIfFull()
+{
+    if(this->output.size() >= this->flushThreshold) this->flush();
+}
+void Emitter::close()
+{
+    if(this->outputFd < 0) return;
+    this->flush();
+    if(this->writer) {
+        this->writer->finish();
+        this->writer.reset();
+    }
+    else {
+        ::close(this->outputFd);
+    }
+    this->outputFd = -1;
+}
+// Hands the descriptor to a writer thread, after writing out what has
+// been buffered so far.
+void Emitter::enableAsyncOutput()
+{
+    if(this->writer || this->outputFd < 0) return;
+    this->flush();
+    this->writer = std::make_unique<AsyncWriter>(this->outputFd, this->output.capacity());
+}
 Emitter* Emitter::getDefault()
 {
     return Emitter::instance;
 }
-std::string Emitter::getSymbolString(Symbol* s)
+void Emitter::appendSymbolString(fmt::memory_buffer& out, operand_t operand)
 {
+    SymbolTable* st = SymbolTable::getDefault();
+    size_t index = Instruction::symbolOf(operand);
+    Symbol* s = st->at(index);
     if(s->getSymbolType()==SymbolTypes::ST_ID)
     {
-        if(s->getIsReference()) {
-            return fmt::format("*{}", s->getAddress());
+        if(Instruction::isIndirect(operand)) {
+            fmt::format_to(fmt::appender(out), FMT_COMPILE("*{}"), s->getAddress());
         }
         else {
-            return fmt::format("{}", s->getAddress());
+            fmt::format_to(fmt::appender(out), FMT_COMPILE("{}"), s->getAddress());
         }
-        
     }
     else if(s->getSymbolType()==SymbolTypes::ST_NUM)
     {
-        return fmt::format("#{}", s->getAttribute());
+        out.push_back('#');
+        std::string_view attribute = st->getAttribute(index);
+        out.append(attribute.data(), attribute.data()+attribute.size());
+    }
+    else {
+        out.append(fmt::string_view("<ERROR>"));
     }
-    return "<ERROR>";
 }
-
-void Emitter::generateCode(std::string operation, size_t s1i,  size_t s2i, size_t s3i, std::string comment)
+void Emitter::appendLabel(fmt::memory_buffer& out, Label label)
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s1i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out = fmt::format(
-        "{}.{} {}, {}, {};", 
-        operation, 
-        typeChar, 
-        this->getSymbolString(st->at(s1i)),
-        this->getSymbolString(st->at(s2i)),
-        this->getSymbolString(st->at(s3i))
-    );
-    this->outputFile << '\t' << out << " " << comment << "\n";
-    fmt::print("{}\n", comment);
-}
-void Emitter::generateCode(std::string operation, size_t s1i, size_t s2i, std::string comment)
+    fmt::format_to(fmt::appender(out), FMT_COMPILE("lab{}{}"), label.index, labelKindToSuffix(label.kind));
+}
+size_t Emitter::codeOffset()
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s1i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out =  fmt::format(
-        "{}.{} {}, {};", 
-        operation, 
-        typeChar, 
-        this->getSymbolString(st->at(s1i)),
-        this->getSymbolString(st->at(s2i))
-    );
-    this->outputFile << '\t' << out << " " << comment << "\n";
-    fmt::print("{}\n", comment);
-}
-void Emitter::generateCode(std::string operation, size_t s1i, std::string comment)
+    return this->flushedBytes + this->output.size() - sizeof(BYTECODE_MAGIC);
+}
+
+VarTypes Emitter::typeOf(size_t index)
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s1i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out =  fmt::format(
-        "{}.{} {};", 
-        operation, 
-        typeChar, 
-        this->getSymbolString(st->at(s1i))
-    );
-    this->outputFile << '\t' << out << " " << comment << "\n";
-    fmt::print("{}\n", comment);
-}
-void Emitter::generateCodeConst(std::string operation, size_t s1i, std::string constval, size_t s3i, std::string comment)
+    return SymbolTable::getDefault()->at(index)->getVarType()==VarTypes::VT_INT ? VarTypes::VT_INT : VarTypes::VT_REAL;
+}
+Instruction& Emitter::record(Opcodes operation, VarTypes type, fmt::string_view comment)
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s1i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out = fmt::format(
-        "{}.{} {}, {}, {};", 
-        operation, 
-        typeChar, 
-        this->getSymbolString(st->at(s1i)),
-        constval,
-        this->getSymbolString(st->at(s3i))
-    );
-    this->outputFile << '\t' << out << " " << comment << "\n";
-    fmt::print("{}\n", comment);
-}
-void Emitter::generateCodeConst(std::string operation, size_t s1i, size_t s2i, std::string constval, std::string comment)
+    Instruction& ins = this->ir.append(operation, type);
+    if(this->areCommentsEnabled() && comment.size() > 0) {
+        ins.comment = this->ir.addComment(std::string_view(comment.data(), comment.size()));
+        TRACE(TC_EMIT, TL_INFO, "{}\n", comment);
+    }
+    return ins;
+}
+// Whether an operand is read through its address is fixed when the
+// instruction is recorded; array element temporaries only become
+// references after the instruction computing their address.
+void Emitter::recordOperand(Instruction& ins, size_t index)
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s1i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out = fmt::format(
-        "{}.{} {}, {}, {};", 
-        operation, 
-        typeChar, 
-        this->getSymbolString(st->at(s1i)),
-        this->getSymbolString(st->at(s2i)),
-        constval
-    );
-    this->outputFile << '\t' << out << " " << comment << "\n";
-    fmt::print("{}\n", comment);
-}
-void Emitter::generateCodeConst(std::string operation, std::string constval, size_t s2i, std::string comment)
+    operand_t operand = (operand_t)index;
+    if(SymbolTable::getDefault()->at(index)->getIsReference()) operand |= IR_INDIRECT;
+    ins.operands[ins.operandCount++] = operand;
+}
+void Emitter::recordOperand(Instruction& ins, Immediate immediate)
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s2i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out = fmt::format(
-        "{}.{} {}, {};", 
-        operation, 
-        typeChar, 
-        constval,
-        this->getSymbolString(st->at(s2i))
-    );
-    this->outputFile << '\t' << out << " " << comment << "\n";
-    fmt::print("{}\n", comment);
-}
-void Emitter::generateCodeConst(std::string operation, size_t s1i, std::string constval2, std::string constval3, std::string comment)
+    ins.operands[ins.operandCount++] = (operand_t)SymbolTable::getDefault()->insertOrGetIntegerConstant(immediate.value);
+}
+void Emitter::recordOperand(Instruction& ins, Label label)
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s1i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out = fmt::format(
-        "{}.{} {}, {}, {};", 
-        operation, 
-        typeChar, 
-        this->getSymbolString(st->at(s1i)),
-        constval2,
-        constval3
-    );
-    this->outputFile << '\t' << out << " " << comment << "\n";
-    fmt::print("{}\n", comment);
+    ins.label = label.index;
+    ins.labelKind = label.kind;
 }
 void Emitter::subFromZero(size_t s1i, size_t s2i) 
 {
-    SymbolTable* st = SymbolTable::getDefault();
-    char typeChar = st->at(s1i)->getVarType()==VarTypes::VT_INT?'i':'r';
-    std::string out = fmt::format(
-        "sub.{} #0, {}, {};", 
-        typeChar, 
-        this->getSymbolString(st->at(s1i)),
-        this->getSymbolString(st->at(s2i))
-    );
-    this->outputFile << '\t' << out << " " <<  "\n";
+    this->generateCode(Opcodes::OP_SUB, "", Immediate{0}, s1i, s2i);
+}
+void Emitter::generateLabel(Label label)
+{
+    this->ir.appendLabel(label);
+}
+void Emitter::generateJump(Label label)
+{
+    Instruction& ins = this->ir.append(Opcodes::OP_JUMP, VarTypes::VT_INT);
+    this->recordOperand(ins, label);
 }
-void Emitter::generateRaw(std::string raw)
+void Emitter::endStatement()
 {
-    this->outputFile << raw << " " <<  "\n";
-    fmt::print("{}\n", raw);
+    if(this->ir.size() >= IR_FLUSH_INSTRUCTIONS || this->ir.commentBytes() >= this->flushThreshold) {
+        this->lower();
+    }
+}
+
+void Emitter::lower()
+{
+    if(this->optimizationLevel >= 2) {
+        numberValues(this->ir);
+        propagateCopies(this->ir);
+        forwardDestinations(this->ir);
+        removeDeadTemporaries(this->ir);
+    }
+    if(this->optimizationLevel >= 1) this->peephole.run(this->ir);
+    for(size_t i = 0; i < this->ir.size(); i++)
+    {
+        this->writeInstruction(this->ir[i]);
+    }
+    this->ir.clear();
+}
+void Emitter::writeInstruction(const Instruction& ins)
+{
+    switch(ins.op)
+    {
+        case Opcodes::OP_LABEL:
+            if(this->format == EmitFormats::EF_BYTECODE) {
+                this->labelOffsets.push_back(LabelOffset{ins.getLabel(), this->codeOffset()});
+                return;
+            }
+            Emitter::appendLabel(this->output, ins.getLabel());
+            this->output.append(fmt::string_view(":\n"));
+            break;
+        case Opcodes::OP_EXIT:
+            if(this->format == EmitFormats::EF_BYTECODE) this->output.push_back((char)Opcodes::OP_EXIT);
+            else this->output.append(fmt::string_view("\texit;\n"));
+            break;
+        default:
+            this->beginInstruction(ins.op, (VarTypes)ins.type);
+            for(uint8_t i = 0; i < ins.operandCount; i++)
+            {
+                this->appendOperand(ins.operands[i]);
+            }
+            if(ins.hasLabel()) this->appendOperand(ins.getLabel());
+            // jumps never carried a comment field
+            this->endInstruction(this->ir.getComment(ins.comment), ins.op != Opcodes::OP_JUMP);
+            break;
+    }
+    this->flushIfFull();
+}
+void Emitter::beginInstruction(Opcodes operation, VarTypes type)
+{
+    if(this->format == EmitFormats::EF_BYTECODE) {
+        this->output.push_back((char)(type == VarTypes::VT_INT ? operation : operation | OPCODE_REAL_BIT));
+        return;
+    }
+    fmt::format_to(fmt::appender(this->output), FMT_COMPILE("\t{}.{} "), opcodeToString(operation), type == VarTypes::VT_INT ? 'i' : 'r');
+    this->firstOperand = true;
+}
+void Emitter::appendOperand(operand_t operand)
+{
+    if(this->format == EmitFormats::EF_BYTECODE) {
+        SymbolTable* st = SymbolTable::getDefault();
+        size_t index = Instruction::symbolOf(operand);
+        Symbol* s = st->at(index);
+        if(s->getSymbolType()==SymbolTypes::ST_ID) {
+            OperandTags tag = Instruction::isIndirect(operand) ? OperandTags::OT_INDIRECT : OperandTags::OT_ADDRESS;
+            appendVarint(this->output, ((uint64_t)s->getAddress() << OPERAND_TAG_BITS) | tag);
+        }
+        else if(s->getVarType()==VarTypes::VT_REAL) {
+            double value = st->getRealConstant(index);
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            appendVarint(this->output, OperandTags::OT_REAL);
+            for(int i = 0; i < 8; i++) this->output.push_back((char)(bits >> (8*i)));
+        }
+        else {
+            int64_t value = st->getIntegerConstant(index);
+            uint64_t payload = zigzagEncode(value);
+            if(payload >> (64 - OPERAND_TAG_BITS)) {
+                throw std::runtime_error(fmt::format("Immediate {} does not fit in a bytecode operand.", value));
+            }
+            appendVarint(this->output, (payload << OPERAND_TAG_BITS) | OperandTags::OT_IMMEDIATE);
+        }
+        return;
+    }
+    if(!this->firstOperand) this->output.append(fmt::string_view(", "));
+    this->firstOperand = false;
+    this->appendSymbolString(this->output, operand);
+}
+void Emitter::appendOperand(Label label)
+{
+    if(this->format == EmitFormats::EF_BYTECODE) {
+        appendVarint(this->output, ((uint64_t)label.index << OPERAND_TAG_BITS) | OperandTags::OT_LABEL);
+        return;
+    }
+    if(!this->firstOperand) this->output.append(fmt::string_view(", "));
+    this->firstOperand = false;
+    this->output.push_back('#');
+    Emitter::appendLabel(this->output, label);
+}
+void Emitter::endInstruction(std::string_view comment, bool commentField)
+{
+    if(this->format == EmitFormats::EF_BYTECODE) return;
+    if(this->commentsEnabled && commentField) {
+        fmt::format_to(fmt::appender(this->output), FMT_COMPILE("; {}\n"), comment);
+    }
+    else {
+        this->output.append(fmt::string_view(";\n"));
+    }
 }
 void Emitter::beginProgram()
 {
-    fmt::print("Begin program\n");
+    TRACE(TC_EMIT, TL_INFO, "Begin program\n");
     SymbolTable *st = SymbolTable::getDefault();
     st->clearIdentifierList(); // idlist is filled with input output
-    std::string label = fmt::format("lab{}",st->getNextLabelIndex());
-    this->outputFile << fmt::format("\tjump.i #{};\n", label);
-    this->outputFile << fmt::format("{}:\n", label);
+    if(this->format == EmitFormats::EF_BYTECODE) {
+        this->output.append(BYTECODE_MAGIC, BYTECODE_MAGIC + sizeof(BYTECODE_MAGIC));
+    }
+    Label label = st->getNextLabelIndex();
+    this->generateJump(label);
+    this->generateLabel(label);
 }
 void Emitter::endProgram()
 {
-    this->outputFile << fmt::format("\texit;\n");
-    this->outputFile.close();
+    TRACE(TC_EMIT, TL_INFO, "Data size: {} bytes\n", SymbolTable::getDefault()->getDataSize());
+    this->ir.append(Opcodes::OP_EXIT, VarTypes::VT_NOTYPE);
+    this->lower();
+    if(this->optimizationLevel >= 1) this->peephole.traceHits();
+    if(this->format == EmitFormats::EF_BYTECODE) {
+        size_t codeSize = this->codeOffset();
+        if(codeSize > UINT32_MAX) throw std::runtime_error("Program too large for bytecode.");
+        appendVarint(this->output, this->labelOffsets.size());
+        for(const LabelOffset& l : this->labelOffsets)
+        {
+            appendVarint(this->output, l.label.index);
+            this->output.push_back((char)l.label.kind);
+            appendVarint(this->output, l.offset);
+        }
+        appendVarint(this->output, SymbolTable::getDefault()->getDataSize());
+        for(int i = 0; i < 4; i++) this->output.push_back((char)(codeSize >> (8*i)));
+    }
+    this->close();
 }
 void Emitter::setDefault()
 {
     Emitter::instance = this;
-}
\ No newline at end of file
+}
+void Emitter::setCommentsEnabled(bool enabled)
+{
+    this->commentsEnabled = enabled;
+}
+// Comments only exist in the textual format.
+bool Emitter::areCommentsEnabled()
+{
+    return this->commentsEnabled && this->format == EmitFormats::EF_ASM;
+}
+void Emitter::setFormat(EmitFormats format)
+{
+    this->format = format;
+}
+EmitFormats Emitter::getFormat()
+{
+    return this->format;
+}
+void Emitter::setOptimizationLevel(int level)
+{
+    this->optimizationLevel = level;
+}
+int Emitter::getOptimizationLevel()
+{
+    return this->optimizationLevel;
+}
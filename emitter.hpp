@@ -1,28 +1,110 @@
 #pragma once
 #include <vector>
 #include <string>
-#include <fstream>
+#include <fmt/format.h>
+#include <cstdint>
+#include <type_traits>
+#include <memory>
 #include "symboltable.hpp"
-std::string operatorTokenToString(address_t token);
+#include "bytecode.hpp"
+#include "asyncwriter.hpp"
+#include "ir.hpp"
+#include "peephole.hpp"
+const char* operatorTokenToString(address_t token);
+// Operand kinds besides symbol indices, which are passed as plain integers.
+// Immediates and Label operands are written with a leading '#'.
+struct Immediate {
+    int64_t value;
+};
+const size_t DEFAULT_FLUSH_THRESHOLD = 1 << 20;
+enum EmitFormats {
+    EF_ASM = 0,
+    EF_BYTECODE = 1
+};
+// Instructions recorded in the IR are lowered in chunks of about this
+// many, at statement boundaries, so memory stays bounded on huge inputs.
+const size_t IR_FLUSH_INSTRUCTIONS = 1 << 16;
 class Emitter {
 private:
-    std::fstream outputFile;
+    int outputFd = -1;
     static Emitter * instance;
+    // output accumulates here and goes out in large write(2) calls
+    fmt::memory_buffer output;
+    size_t flushThreshold;
+    // set when a writer thread owns the descriptor
+    std::unique_ptr<AsyncWriter> writer;
+    // code recorded since the last lowering
+    IR ir;
+    Peephole peephole;
+    bool firstOperand;
+    bool commentsEnabled = true;
+    int optimizationLevel = 0;
+    EmitFormats format = EmitFormats::EF_ASM;
+    // bytecode only: bytes already written and the label table
+    size_t flushedBytes = 0;
+    struct LabelOffset {
+        Label label;
+        size_t offset;
+    };
+    std::vector<LabelOffset> labelOffsets;
+    size_t codeOffset();
+    void flushIfFull();
+    Instruction& record(Opcodes operation, VarTypes type, fmt::string_view comment);
+    void recordOperand(Instruction& ins, size_t index);
+    void recordOperand(Instruction& ins, Immediate immediate);
+    void recordOperand(Instruction& ins, Label label);
+    static VarTypes typeOf(size_t index);
+    // The instruction type comes from its first symbol operand.
+    template<typename Operand, typename... Rest>
+    static VarTypes typeOf(Operand operand, Rest... rest)
+    {
+        if constexpr(std::is_integral<Operand>::value) {
+            return Emitter::typeOf((size_t)operand);
+        }
+        else {
+            static_assert(sizeof...(Rest) > 0, "an instruction needs a symbol operand");
+            return Emitter::typeOf(rest...);
+        }
+    }
+    // lowering of the recorded IR to the output format
+    void lower();
+    void writeInstruction(const Instruction& ins);
+    void beginInstruction(Opcodes operation, VarTypes type);
+    void appendOperand(operand_t operand);
+    void appendOperand(Label label);
+    void endInstruction(std::string_view comment, bool commentField);
 public:
-    Emitter(std::string outputfile);
+    // Takes ownership of fd and closes it at the end of the program.
+    Emitter(int fd, size_t flushThreshold=DEFAULT_FLUSH_THRESHOLD);
+    Emitter(std::string outputfile, size_t flushThreshold=DEFAULT_FLUSH_THRESHOLD);
+    static int openOutput(const std::string& filename);
+    ~Emitter();
     static Emitter* getDefault();
-    void generateCode(std::string operation, size_t s1, size_t s2, size_t s3, std::string comment);
-    void generateCode(std::string operation, size_t s1, size_t s2, std::string comment);
-    void generateCode(std::string operation, size_t s1, std::string comment);
-    void generateCodeConst(std::string operation, size_t s1, std::string constval, size_t s3, std::string comment);
-    void generateCodeConst(std::string operation, size_t s1, size_t s3, std::string constval, std::string comment);
-    void generateCodeConst(std::string operation, std::string constval, size_t s2i, std::string comment);
-    void generateCodeConst(std::string operation, size_t s1i, std::string constval2, std::string constval3, std::string comment);
-    void generateRaw(std::string raw);
+    // Records "<operation>.<type> <operands>; <comment>". Operands are
+    // symbol indices, Immediate or Label values, in output order.
+    template<typename... Operands>
+    void generateCode(Opcodes operation, fmt::string_view comment, Operands... operands)
+    {
+        Instruction& ins = this->record(operation, Emitter::typeOf(operands...), comment);
+        (this->recordOperand(ins, operands), ...);
+    }
+    void generateLabel(Label label);
+    void generateJump(Label label);
     void subFromZero(size_t s1, size_t s2);
-    std::string getSymbolString(Symbol* s);
+    // Ends a statement; lowers the IR once enough of it has accumulated.
+    void endStatement();
+    void appendSymbolString(fmt::memory_buffer& out, operand_t operand);
+    static void appendLabel(fmt::memory_buffer& out, Label label);
     void beginProgram();
     void endProgram();
     void setDefault();
+    void flush();
+    void close();
+    void enableAsyncOutput();
+    void setFormat(EmitFormats format);
+    EmitFormats getFormat();
+    void setCommentsEnabled(bool enabled);
+    bool areCommentsEnabled();
+    void setOptimizationLevel(int level);
+    int getOptimizationLevel();
 };
-
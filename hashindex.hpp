@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+// Open-addressing (linear probing) index from a key hash to a position in
+// an external array. Keys are not stored here, the caller supplies an
+// equality predicate that compares the probed position with its key.
+class HashIndex {
+private:
+    struct Slot {
+        size_t hash;
+        size_t value; // position+1, 0 marks an empty slot
+    };
+    std::vector<Slot> slots;
+    size_t count = 0;
+    size_t mask() const { return this->slots.size()-1; }
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(this->slots);
+        this->slots.assign(old.empty() ? 64 : old.size()*2, Slot{0,0});
+        for(const Slot& s : old)
+        {
+            if(!s.value) continue;
+            size_t i = s.hash & this->mask();
+            while(this->slots[i].value) i = (i+1) & this->mask();
+            this->slots[i] = s;
+        }
+    }
+public:
+    template<typename Eq>
+    bool find(size_t hash, Eq equals, size_t& position) const
+    {
+        if(this->slots.empty()) return false;
+        for(size_t i = hash & this->mask(); this->slots[i].value; i = (i+1) & this->mask())
+        {
+            const Slot& s = this->slots[i];
+            if(s.hash == hash && equals(s.value-1))
+            {
+                position = s.value-1;
+                return true;
+            }
+        }
+        return false;
+    }
+    // Does not check for duplicates, call find first.
+    void insert(size_t hash, size_t position)
+    {
+        if((this->count+1)*2 > this->slots.size()) this->grow();
+        size_t i = hash & this->mask();
+        while(this->slots[i].value) i = (i+1) & this->mask();
+        this->slots[i] = Slot{hash, position+1};
+        this->count++;
+    }
+    void reserve(size_t n)
+    {
+        while(n*2 > this->slots.size()) this->grow();
+    }
+    size_t size() const { return this->count; }
+};
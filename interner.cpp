@@ -0,0 +1,67 @@
+#include "interner.hpp"
+#include <cstring>
+size_t StringInterner::hash(const char* s, size_t length)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for(size_t i = 0; i < length; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return (size_t)h;
+}
+const char* StringInterner::store(const char* s, size_t length)
+{
+    if(this->blockUsed + length > this->blockCapacity) {
+        size_t capacity = length > BlockSize ? length : BlockSize;
+        this->blocks.emplace_back(new char[capacity]);
+        this->blockCapacity = capacity;
+        this->blockUsed = 0;
+    }
+    char* destination = this->blocks.back().get() + this->blockUsed;
+    std::memcpy(destination, s, length);
+    this->blockUsed += length;
+    return destination;
+}
+bool StringInterner::tryGetAtom(const char* s, size_t length, atom_t& atom) const
+{
+    size_t position;
+    bool found = this->index.find(StringInterner::hash(s, length), [&](size_t i){
+        const Entry& e = this->entries[i];
+        return e.length == length && std::memcmp(e.data, s, length) == 0;
+    }, position);
+    if(found) atom = (atom_t)position;
+    return found;
+}
+atom_t StringInterner::intern(const char* s, size_t length)
+{
+    atom_t atom;
+    if(this->tryGetAtom(s, length, atom)) return atom;
+    atom = (atom_t)this->entries.size();
+    this->entries.push_back(Entry{this->store(s, length), length});
+    this->index.insert(StringInterner::hash(s, length), atom);
+    return atom;
+}
+atom_t StringInterner::intern(std::string_view s)
+{
+    return this->intern(s.data(), s.size());
+}
+std::string_view StringInterner::view(atom_t atom) const
+{
+    const Entry& e = this->entries.at(atom);
+    return std::string_view(e.data, e.length);
+}
+size_t StringInterner::size() const
+{
+    return this->entries.size();
+}
+void StringInterner::reserve(size_t atoms, size_t characters)
+{
+    this->entries.reserve(atoms);
+    this->index.reserve(atoms);
+    if(this->blocks.empty() && characters > BlockSize) {
+        this->blocks.emplace_back(new char[characters]);
+        this->blockCapacity = characters;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "hashindex.hpp"
+typedef uint32_t atom_t;
+const atom_t NO_ATOM = UINT32_MAX;
+// Stores every distinct spelling once in a contiguous character arena and
+// hands out dense 32-bit atom ids for them. Interning an already known
+// spelling does not allocate. The arena grows by whole blocks, so views
+// returned by view() stay valid for the interner's lifetime.
+class StringInterner {
+private:
+    static const size_t BlockSize = 64*1024;
+    struct Entry {
+        const char* data;
+        size_t length;
+    };
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t blockUsed = 0;
+    size_t blockCapacity = 0;
+    std::vector<Entry> entries;
+    HashIndex index;
+    static size_t hash(const char* s, size_t length);
+    const char* store(const char* s, size_t length);
+public:
+    atom_t intern(const char* s, size_t length);
+    atom_t intern(std::string_view s);
+    bool tryGetAtom(const char* s, size_t length, atom_t& atom) const;
+    std::string_view view(atom_t atom) const;
+    size_t size() const;
+    void reserve(size_t atoms, size_t characters);
+};
@@ -0,0 +1,50 @@
+#include "ir.hpp"
+
+Instruction& IR::append(Opcodes op, VarTypes type)
+{
+    this->code.push_back(Instruction{op, (uint8_t)type, 0, LabelKinds::LK_PLAIN, {0, 0, 0}, NO_IR_LABEL, NO_COMMENT});
+    return this->code.back();
+}
+void IR::appendLabel(Label label)
+{
+    Instruction& ins = this->append(Opcodes::OP_LABEL, VarTypes::VT_NOTYPE);
+    ins.label = label.index;
+    ins.labelKind = label.kind;
+}
+uint32_t IR::addComment(std::string_view comment)
+{
+    this->commentStarts.push_back((uint32_t)this->commentText.size());
+    this->commentText.insert(this->commentText.end(), comment.begin(), comment.end());
+    return (uint32_t)this->commentStarts.size() - 1;
+}
+std::string_view IR::getComment(uint32_t comment) const
+{
+    if(comment == NO_COMMENT) return std::string_view();
+    size_t start = this->commentStarts[comment];
+    size_t end = comment+1 < this->commentStarts.size() ? this->commentStarts[comment+1] : this->commentText.size();
+    return std::string_view(this->commentText.data() + start, end - start);
+}
+size_t IR::commentBytes() const
+{
+    return this->commentText.size();
+}
+size_t IR::size() const
+{
+    return this->code.size();
+}
+void IR::reserve(size_t instructions, size_t commentBytes)
+{
+    this->code.reserve(instructions);
+    this->commentText.reserve(commentBytes);
+    this->commentStarts.reserve(instructions);
+}
+void IR::truncate(size_t size)
+{
+    this->code.resize(size);
+}
+void IR::clear()
+{
+    this->code.clear();
+    this->commentText.clear();
+    this->commentStarts.clear();
+}
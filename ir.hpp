@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include "vartypes.hpp"
+#include "label.hpp"
+#include "bytecode.hpp"
+// Three-address code between the parser and the output formats. Each
+// instruction is a fixed 24-byte record in one dense vector; passes walk
+// it linearly and the emitter lowers it to text or bytecode at the end.
+//
+// An operand is a 32-bit handle: the symbol index (temporaries keep their
+// TEMPORARY_BIT) with IR_INDIRECT set when the operand is read through
+// the address it holds, as captured when the instruction was recorded.
+// Jumps carry their target in label, OP_LABEL records define a label.
+typedef uint32_t operand_t;
+const operand_t IR_INDIRECT = (operand_t)1 << 30;
+const uint32_t NO_IR_LABEL = UINT32_MAX;
+const uint32_t NO_COMMENT = UINT32_MAX;
+struct Instruction {
+    Opcodes op;
+    uint8_t type; // VarTypes
+    uint8_t operandCount;
+    LabelKinds labelKind;
+    operand_t operands[3];
+    uint32_t label;
+    uint32_t comment;
+    bool hasLabel() const
+    {
+        return this->label != NO_IR_LABEL;
+    }
+    Label getLabel() const
+    {
+        return Label{this->label, this->labelKind};
+    }
+    // mov and the computations write their last operand, the rest only read
+    bool writesLastOperand() const
+    {
+        return this->op == Opcodes::OP_MOV || (this->op >= Opcodes::OP_ADD && this->op <= Opcodes::OP_OR)
+            || this->op == Opcodes::OP_INTTOREAL || this->op == Opcodes::OP_REALTOINT;
+    }
+    // A destination written through a reference reads the reference.
+    uint8_t readOperandCount() const
+    {
+        if(this->writesLastOperand() && !Instruction::isIndirect(this->operands[this->operandCount-1])) return this->operandCount-1;
+        return this->operandCount;
+    }
+    static size_t symbolOf(operand_t operand)
+    {
+        return operand & ~IR_INDIRECT;
+    }
+    static bool isIndirect(operand_t operand)
+    {
+        return operand & IR_INDIRECT;
+    }
+};
+static_assert(sizeof(Instruction) == 24, "IR instructions should stay 24 bytes");
+
+class IR {
+private:
+    std::vector<Instruction> code;
+    std::vector<char> commentText;
+    std::vector<uint32_t> commentStarts;
+public:
+    Instruction& append(Opcodes op, VarTypes type);
+    void appendLabel(Label label);
+    uint32_t addComment(std::string_view comment);
+    std::string_view getComment(uint32_t comment) const;
+    size_t commentBytes() const;
+    Instruction& operator[](size_t i)
+    {
+        return this->code[i];
+    }
+    const Instruction& operator[](size_t i) const
+    {
+        return this->code[i];
+    }
+    size_t size() const;
+    void reserve(size_t instructions, size_t commentBytes);
+    // Drops instructions for which keep returns false, preserving order.
+    template<typename Keep>
+    void compact(Keep keep)
+    {
+        size_t out = 0;
+        for(size_t i = 0; i < this->code.size(); i++)
+        {
+            if(keep(this->code[i])) this->code[out++] = this->code[i];
+        }
+        this->code.resize(out);
+    }
+    // Drops the instructions from size on.
+    void truncate(size_t size);
+    // Empties the IR and keeps its storage.
+    void clear();
+};
@@ -0,0 +1,313 @@
+#include "iropt.hpp"
+#include "symboltable.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+typedef uint32_t value_t;
+struct ValueKey {
+    uint32_t operation; // opcode << 8 | type
+    value_t lhs;
+    value_t rhs;
+    bool operator==(const ValueKey& other) const
+    {
+        return this->operation == other.operation && this->lhs == other.lhs && this->rhs == other.rhs;
+    }
+};
+struct ValueKeyHash {
+    size_t operator()(const ValueKey& key) const
+    {
+        uint64_t h = (((uint64_t)key.lhs << 32) | key.rhs) * 0x9E3779B97F4A7C15ull;
+        return (size_t)(h ^ (h >> 29) ^ key.operation);
+    }
+};
+bool isCommutative(Opcodes op)
+{
+    return op == Opcodes::OP_ADD || op == Opcodes::OP_MUL || op == Opcodes::OP_AND || op == Opcodes::OP_OR;
+}
+class ValueNumbering {
+private:
+    // a dropped computation whose temporary is read from the holder instead
+    struct Forward {
+        operand_t holder;
+        value_t value;
+        size_t position;
+        Opcodes op;
+    };
+    IR& ir;
+    SymbolTable* st;
+    value_t nextValue = 1;
+    std::unordered_map<address_t, value_t> locationValues;
+    std::unordered_map<size_t, value_t> constantValues;
+    std::unordered_map<ValueKey, value_t, ValueKeyHash> computedValues;
+    // the location a value was first put in, valid while it still holds it
+    std::unordered_map<value_t, operand_t> holders;
+    std::unordered_map<size_t, Forward> forwards;
+    address_t addressOf(operand_t operand)
+    {
+        return this->st->at(Instruction::symbolOf(operand))->getAddress();
+    }
+    value_t valueOf(operand_t operand)
+    {
+        // what a reference points to is unknown
+        if(Instruction::isIndirect(operand)) return this->nextValue++;
+        size_t index = Instruction::symbolOf(operand);
+        if(this->st->at(index)->getSymbolType() == SymbolTypes::ST_NUM) {
+            auto inserted = this->constantValues.try_emplace(index, this->nextValue);
+            if(inserted.second) this->nextValue++;
+            return inserted.first->second;
+        }
+        auto inserted = this->locationValues.try_emplace(this->addressOf(operand), this->nextValue);
+        if(inserted.second) this->nextValue++;
+        return inserted.first->second;
+    }
+    bool holds(operand_t location, value_t value)
+    {
+        auto found = this->locationValues.find(this->addressOf(location));
+        return found != this->locationValues.end() && found->second == value;
+    }
+    void assign(operand_t location, value_t value)
+    {
+        this->locationValues[this->addressOf(location)] = value;
+        auto holder = this->holders.find(value);
+        if(holder == this->holders.end()) {
+            this->holders.emplace(value, location);
+        }
+        else if(!this->holds(holder->second, value)) {
+            holder->second = location;
+        }
+    }
+    // Labels forget everything, so nothing is forwarded past one.
+    void forgetBlock()
+    {
+        this->locationValues.clear();
+        this->computedValues.clear();
+        this->holders.clear();
+    }
+    void redirectReads(Instruction& ins);
+public:
+    ValueNumbering(IR& ir) : ir(ir), st(SymbolTable::getDefault()) {}
+    void run();
+};
+// Reads of a dropped computation's temporary go to the holder while it
+// still holds the value. Once it does not, the computation is put back,
+// its temporary's slot was treated as unknown since it was dropped.
+void ValueNumbering::redirectReads(Instruction& ins)
+{
+    size_t reads = ins.readOperandCount();
+    for(size_t k = 0; k < reads; k++)
+    {
+        auto forward = this->forwards.find(Instruction::symbolOf(ins.operands[k]));
+        if(forward == this->forwards.end()) continue;
+        if(this->holds(forward->second.holder, forward->second.value)) {
+            ins.operands[k] = forward->second.holder | (ins.operands[k] & IR_INDIRECT);
+        }
+        else {
+            this->ir[forward->second.position].op = forward->second.op;
+            this->forwards.erase(forward);
+        }
+    }
+}
+void ValueNumbering::run()
+{
+    for(size_t i = 0; i < this->ir.size(); i++)
+    {
+        Instruction& ins = this->ir[i];
+        if(ins.op == Opcodes::OP_LABEL) {
+            this->forgetBlock();
+            continue;
+        }
+        this->redirectReads(ins);
+        if(!ins.writesLastOperand()) continue;
+        operand_t destination = ins.operands[ins.operandCount-1];
+        if(Instruction::isIndirect(destination)) {
+            this->forgetBlock();
+            continue;
+        }
+        size_t destinationIndex = Instruction::symbolOf(destination);
+        this->forwards.erase(destinationIndex);
+        value_t value;
+        bool computedBefore = false;
+        if(ins.op == Opcodes::OP_MOV) {
+            operand_t source = ins.operands[0];
+            // a mov of another width copies different bits
+            bool sameType = this->st->at(Instruction::symbolOf(source))->getVarType() == (VarTypes)ins.type;
+            value = sameType ? this->valueOf(source) : this->nextValue++;
+        }
+        else {
+            ValueKey key{(uint32_t)ins.op << 8 | ins.type, this->valueOf(ins.operands[0]), 0};
+            if(ins.operandCount == 3) key.rhs = this->valueOf(ins.operands[1]);
+            if(isCommutative(ins.op) && key.lhs > key.rhs) std::swap(key.lhs, key.rhs);
+            auto inserted = this->computedValues.try_emplace(key, this->nextValue);
+            if(inserted.second) this->nextValue++;
+            value = inserted.first->second;
+            computedBefore = !inserted.second;
+        }
+        if(this->holds(destination, value)) {
+            ins.op = Opcodes::OP_NOP;
+            continue;
+        }
+        if(computedBefore && this->st->at(destinationIndex)->isTemporary()) {
+            auto holder = this->holders.find(value);
+            if(holder != this->holders.end() && this->holds(holder->second, value)) {
+                this->forwards[destinationIndex] = Forward{holder->second, value, i, ins.op};
+                this->locationValues[this->addressOf(destination)] = this->nextValue++;
+                ins.op = Opcodes::OP_NOP;
+                continue;
+            }
+        }
+        this->assign(destination, value);
+    }
+    this->ir.compact([](const Instruction& ins) { return ins.op != Opcodes::OP_NOP; });
+}
+// Whether a temporary's value is read later, for a walk backwards over a
+// chunk. The code generator only passes values between blocks under the
+// name they were written with, and never around a loop, so names read
+// anywhere later count. Value numbering also leaves reads of a slot another
+// temporary wrote, and a relation puts labels between the two, so slots
+// count until written again whatever labels lie in between.
+class Liveness {
+private:
+    SymbolTable* st = SymbolTable::getDefault();
+    std::unordered_set<size_t> namesRead;
+    std::unordered_set<address_t> slotsRead;
+public:
+    bool isRead(operand_t temporary)
+    {
+        size_t index = Instruction::symbolOf(temporary);
+        return this->namesRead.count(index) || this->slotsRead.count(this->st->at(index)->getAddress());
+    }
+    // Takes in the instruction before the ones seen so far.
+    void step(const Instruction& ins)
+    {
+        if(ins.op == Opcodes::OP_LABEL) return;
+        if(ins.writesLastOperand() && !Instruction::isIndirect(ins.operands[ins.operandCount-1])) {
+            this->slotsRead.erase(this->st->at(Instruction::symbolOf(ins.operands[ins.operandCount-1]))->getAddress());
+        }
+        size_t reads = ins.readOperandCount();
+        for(size_t k = 0; k < reads; k++)
+        {
+            size_t index = Instruction::symbolOf(ins.operands[k]);
+            this->namesRead.insert(index);
+            Symbol* s = this->st->at(index);
+            if(s->getSymbolType() == SymbolTypes::ST_ID) this->slotsRead.insert(s->getAddress());
+        }
+    }
+};
+// The type of the value an instruction writes.
+VarTypes resultType(const Instruction& ins)
+{
+    if(ins.op == Opcodes::OP_INTTOREAL) return VarTypes::VT_REAL;
+    if(ins.op == Opcodes::OP_REALTOINT) return VarTypes::VT_INT;
+    return (VarTypes)ins.type;
+}
+// A division by zero has an effect even when its result is unused.
+bool canDrop(const Instruction& ins)
+{
+    if(ins.op != Opcodes::OP_DIV && ins.op != Opcodes::OP_MOD) return true;
+    SymbolTable *st = SymbolTable::getDefault();
+    size_t divisor = Instruction::symbolOf(ins.operands[1]);
+    if(Instruction::isIndirect(ins.operands[1]) || st->at(divisor)->getSymbolType() != SymbolTypes::ST_NUM) return false;
+    if(ins.type == VarTypes::VT_INT) return st->getIntegerConstant(divisor) != 0;
+    return st->getRealConstant(divisor) != 0.0;
+}
+}
+
+void numberValues(IR& ir)
+{
+    ValueNumbering(ir).run();
+}
+void propagateCopies(IR& ir)
+{
+    SymbolTable *st = SymbolTable::getDefault();
+    // destination location -> the variable it is a copy of
+    std::unordered_map<address_t, operand_t> copies;
+    // variable location -> locations copied from it
+    std::unordered_map<address_t, std::vector<address_t>> copiedTo;
+    for(size_t i = 0; i < ir.size(); i++)
+    {
+        Instruction& ins = ir[i];
+        if(ins.op == Opcodes::OP_LABEL) {
+            copies.clear();
+            copiedTo.clear();
+            continue;
+        }
+        size_t reads = ins.readOperandCount();
+        for(size_t k = 0; k < reads && !copies.empty(); k++)
+        {
+            Symbol* s = st->at(Instruction::symbolOf(ins.operands[k]));
+            if(s->getSymbolType() != SymbolTypes::ST_ID) continue;
+            auto copy = copies.find(s->getAddress());
+            if(copy != copies.end()) ins.operands[k] = copy->second | (ins.operands[k] & IR_INDIRECT);
+        }
+        if(!ins.writesLastOperand()) continue;
+        operand_t destination = ins.operands[ins.operandCount-1];
+        if(Instruction::isIndirect(destination)) {
+            copies.clear();
+            copiedTo.clear();
+            continue;
+        }
+        address_t written = st->at(Instruction::symbolOf(destination))->getAddress();
+        copies.erase(written);
+        auto dependents = copiedTo.find(written);
+        if(dependents != copiedTo.end()) {
+            for(address_t copy : dependents->second)
+            {
+                auto found = copies.find(copy);
+                if(found != copies.end() && st->at(Instruction::symbolOf(found->second))->getAddress() == written) copies.erase(found);
+            }
+            copiedTo.erase(dependents);
+        }
+        if(ins.op != Opcodes::OP_MOV || Instruction::isIndirect(ins.operands[0])) continue;
+        size_t source = Instruction::symbolOf(ins.operands[0]);
+        Symbol* s = st->at(source);
+        // temporaries and array elements are not plain variables
+        if(SymbolTable::isTemporary(source) || s->getSymbolType() != SymbolTypes::ST_ID) continue;
+        if(s->getVarType() != (VarTypes)ins.type || s->getAddress() == written) continue;
+        copies[written] = ins.operands[0];
+        copiedTo[s->getAddress()].push_back(written);
+    }
+}
+void forwardDestinations(IR& ir)
+{
+    SymbolTable *st = SymbolTable::getDefault();
+    Liveness live;
+    for(size_t i = ir.size(); i-- > 0;)
+    {
+        Instruction& ins = ir[i];
+        if(i > 0 && ins.op == Opcodes::OP_MOV && !Instruction::isIndirect(ins.operands[0])) {
+            operand_t temporary = ins.operands[0];
+            Instruction& producer = ir[i-1];
+            if(st->at(Instruction::symbolOf(temporary))->isTemporary() && !live.isRead(temporary) && producer.writesLastOperand()
+                && producer.operands[producer.operandCount-1] == temporary
+                && resultType(producer) == (VarTypes)ins.type) {
+                producer.operands[producer.operandCount-1] = ins.operands[1];
+                // the assignment's comment describes the store better
+                if(ins.comment != NO_COMMENT) producer.comment = ins.comment;
+                ins.op = Opcodes::OP_NOP;
+                continue;
+            }
+        }
+        live.step(ins);
+    }
+    ir.compact([](const Instruction& ins) { return ins.op != Opcodes::OP_NOP; });
+}
+void removeDeadTemporaries(IR& ir)
+{
+    SymbolTable *st = SymbolTable::getDefault();
+    Liveness live;
+    for(size_t i = ir.size(); i-- > 0;)
+    {
+        Instruction& ins = ir[i];
+        if(ins.writesLastOperand()) {
+            operand_t destination = ins.operands[ins.operandCount-1];
+            if(!Instruction::isIndirect(destination) && st->at(Instruction::symbolOf(destination))->isTemporary() && !live.isRead(destination) && canDrop(ins)) {
+                ins.op = Opcodes::OP_NOP;
+                continue;
+            }
+        }
+        live.step(ins);
+    }
+    ir.compact([](const Instruction& ins) { return ins.op != Opcodes::OP_NOP; });
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "ir.hpp"
+// Optimization passes over a chunk of recorded IR, run by the emitter from
+// -O2 just before the chunk is lowered. They see one basic block at a time,
+// blocks end at the labels, and only rely on what the code generator
+// guarantees about temporaries: each is written before it is read and is
+// dead once its statement ends.
+
+// Local value numbering. Every location gets the number of the value it
+// holds and every computation is keyed on (opcode, type, operand numbers).
+// A computation whose key was already seen is dropped when its destination
+// holds that value anyway, or when it goes to a temporary whose reads can
+// use the location the value was first computed into, because nothing
+// overwrites that location before them. Stores update the number of their
+// destination, a store through a reference forgets everything.
+void numberValues(IR& ir);
+// Copy propagation. After a mov from a plain variable, reads of the
+// destination read the variable instead while neither has changed, which
+// usually leaves the mov to removeDeadTemporaries.
+void propagateCopies(IR& ir);
+// Destination forwarding. A computation into a temporary that is only
+// moved on by the next instruction, as every assignment does, writes
+// straight into the mov's destination and the mov goes.
+void forwardDestinations(IR& ir);
+// Drops computations into temporaries that nothing reads afterwards.
+// Divisions that could fault stay.
+void removeDeadTemporaries(IR& ir);
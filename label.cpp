@@ -0,0 +1,24 @@
+#include "label.hpp"
+
+const char* labelKindToSuffix(LabelKinds kind)
+{
+    switch(kind)
+    {
+        case LabelKinds::LK_ELSE:
+            return "_else";
+        case LabelKinds::LK_ENDIF:
+            return "_endif";
+        case LabelKinds::LK_WHILE:
+            return "_while";
+        case LabelKinds::LK_ENDWHILE:
+            return "_endwhile";
+        case LabelKinds::LK_TRUE:
+            return "_true";
+        case LabelKinds::LK_TOTRUE:
+            return "_totrue";
+        case LabelKinds::LK_END:
+            return "_end";
+        default:
+            return "";
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+// Jump targets are numbered, the kind only selects the suffix of the
+// textual name (lab3_else, lab4_endwhile, ...). Labels are compared and
+// stored as plain integers and turned into text once, when emitted.
+enum LabelKinds : uint8_t {
+    LK_PLAIN = 0,
+    LK_ELSE,
+    LK_ENDIF,
+    LK_WHILE,
+    LK_ENDWHILE,
+    LK_TRUE,
+    LK_TOTRUE,
+    LK_END
+};
+const char* labelKindToSuffix(LabelKinds kind);
+struct Label {
+    uint32_t index;
+    LabelKinds kind;
+    bool operator==(const Label& other) const
+    {
+        return this->index == other.index && this->kind == other.kind;
+    }
+    bool operator!=(const Label& other) const
+    {
+        return !(*this == other);
+    }
+};
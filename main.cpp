@@ -1,24 +1,138 @@
 #include "parser.hpp"
 #include "lexer.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <fmt/format.h>
 #include <exception>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
 
 void yyerror(std::string s)
 {
   throw std::runtime_error(s);
 }
-int main()
+static void usage(const char* program)
 {
+    fmt::print(stderr,
+        "usage: {} [options] [input.pas|-]\n"
+        "  -o <path>|-          output file, - for stdout (default myoutput.asm or myoutput.bc)\n"
+        "  -O0 -O1 -O2          optimization level (default -O0, -O means -O1)\n"
+        "  --emit=asm|bytecode  output format (default asm)\n"
+        "  --no-comments        omit comments from asm output\n"
+        "  --async-output       write output on a separate thread\n"
+        "  -v, --verbose        echo emitted code to stderr\n"
+        "  --trace=<spec>       category[:level],... of lexer, symtab, emit, parser, opt, all\n",
+        program);
+}
+int main(int argc, char** argv)
+{
+    bool comments = true;
+    bool asyncOutput = false;
+    int optimizationLevel = 0;
+    EmitFormats format = EmitFormats::EF_ASM;
+    std::string inputPath = "-";
+    std::string outputPath;
+    bool inputGiven = false;
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if(arg == "--no-comments") {
+            comments = false;
+        }
+        else if(arg == "--async-output") {
+            asyncOutput = true;
+        }
+        else if(arg == "--emit=asm") {
+            format = EmitFormats::EF_ASM;
+        }
+        else if(arg == "--emit=bytecode") {
+            format = EmitFormats::EF_BYTECODE;
+        }
+        else if(arg == "-o") {
+            if(i+1 == argc) {
+                usage(argv[0]);
+                exit(1);
+            }
+            outputPath = argv[++i];
+        }
+        else if(arg == "-O") {
+            optimizationLevel = 1;
+        }
+        else if(arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            optimizationLevel = arg[2] - '0';
+        }
+        else if(arg == "-v" || arg == "--verbose") {
+            Trace::setLevel(TraceCategory::TC_EMIT, TraceLevel::TL_INFO);
+        }
+        else if(arg.rfind("--trace=", 0) == 0) {
+            if(!Trace::configure(std::string_view(arg).substr(8))) {
+                fmt::print(stderr, "bad trace specification {}\n", arg);
+                exit(1);
+            }
+        }
+        else if(arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            exit(0);
+        }
+        else if((arg == "-" || arg[0] != '-') && !inputGiven) {
+            inputPath = arg;
+            inputGiven = true;
+        }
+        else {
+            fmt::print(stderr, "unknown option {}\n", arg);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    if(inputPath != "-") {
+        yyin = fopen(inputPath.c_str(), "r");
+        if(!yyin) {
+            fmt::print(stderr, "cannot open {}\n", inputPath);
+            exit(1);
+        }
+    }
+    else {
+        yyin = stdin;
+    }
+    if(outputPath.empty()) {
+        outputPath = format == EmitFormats::EF_BYTECODE ? "myoutput.bc" : "myoutput.asm";
+    }
+
     SymbolTable st;
     st.setDefault();
-    Emitter e("myoutput.asm");
+    // value numbering at -O2 looks for values in the statement's earlier temporaries
+    st.setRecycleWithinStatements(optimizationLevel < 2);
+    struct stat inputStat;
+    if(fstat(fileno(yyin), &inputStat) == 0 && S_ISREG(inputStat.st_mode)) {
+        st.reserveForInputSize(inputStat.st_size);
+    }
+    int outputFd = STDOUT_FILENO;
+    if(outputPath != "-") {
+        try {
+            outputFd = Emitter::openOutput(outputPath);
+        } catch (const std::runtime_error& e) {
+            fmt::print(stderr, "{}\n", e.what());
+            exit(1);
+        }
+    }
+    Ast ast;
+    ast.setDefault();
+    Emitter e(outputFd);
     e.setDefault();
+    e.setFormat(format);
+    e.setCommentsEnabled(comments);
+    e.setOptimizationLevel(optimizationLevel);
+    if(asyncOutput) e.enableAsyncOutput();
+    int status = 0;
     try {
       yyparse();
+    } catch (const CompileError& e) {
+      fmt::print(stderr, "error @{}: {}\n", e.getLine(), e.what());
+      status = 1;
     } catch (const std::runtime_error& e) {
-      fmt::print("error @{}: {}\n", yylineno, e.what());
+      fmt::print(stderr, "error @{}: {}\n", yylineno, e.what());
+      status = 1;
     }
     yylex_destroy();
-    exit(0);
+    exit(status);
 }
@@ -3,6 +3,8 @@
 %code requires {
     #include "symboltable.hpp"
     #include "emitter.hpp"
+    #include "ast.hpp"
+    #include "trace.hpp"
     #include <exception>
     #include <string>
     #include <tuple>
@@ -13,10 +15,7 @@
     const static size_t NO_SYMBOL = -1;
     void yyerror(std::string s);
     int yylex(void);
-    std::string operatorTokenToString(address_t token);
-    bool isResultReal(Symbol * s1, Symbol *s2);
-    size_t convertToReal(size_t stIndex, SymbolTable* st=nullptr, Emitter * e=nullptr);
-    size_t convertToInt(size_t stIndex, SymbolTable* st=nullptr, Emitter * e=nullptr);
+    const char* operatorTokenToString(address_t token);
 }
 %define api.token.prefix {TOK_}
 %define api.value.type {address_t}
@@ -59,7 +58,10 @@ program:
     subprogram_declarations
     compound_statement
     '.'
-    { Emitter::getDefault()->endProgram(); }
+    {
+        Ast::getDefault()->compile($10);
+        Emitter::getDefault()->endProgram();
+    }
     ; 
 
 identifier_list:
@@ -99,8 +101,8 @@ type:
             if(startSym->getVarType() != VarTypes::VT_INT || endSym->getVarType() != VarTypes::VT_INT) {
                 throw std::runtime_error(fmt::format("Expected integer type in array type bounds."));
             }
-            size_t start = std::stoi(startSym->getAttribute());
-            size_t end = std::stoi(endSym->getAttribute());
+            size_t start = st->getIntegerConstant($3);
+            size_t end = st->getIntegerConstant($6);
             if(start > end) {
                 throw std::runtime_error(fmt::format("Expected increasing array bounds."));
             }
@@ -120,12 +122,21 @@ subprogram_declarations:
     ;
 
 subprogram_declaration:
-    subprogram_head declarations compound_statement
+    subprogram_head declarations compound_statement {
+        Ast::getDefault()->compile($3);
+        SymbolTable::getDefault()->leaveScope();
+    }
     ;
 
 subprogram_head:
-    FUNCTION ID arguments ':' standard_type ';'
-    | PROCEDURE ID arguments ';'
+    FUNCTION ID {
+        TRACE(TC_PARSER, TL_INFO, "Function '{}'\n", SymbolTable::getDefault()->getAttribute($2));
+        SymbolTable::getDefault()->enterScope();
+    } arguments ':' standard_type ';'
+    | PROCEDURE ID {
+        TRACE(TC_PARSER, TL_INFO, "Procedure '{}'\n", SymbolTable::getDefault()->getAttribute($2));
+        SymbolTable::getDefault()->enterScope();
+    } arguments ';'
     ;
 
 arguments:
@@ -134,209 +145,58 @@ arguments:
     ;
 
 parameter_list:
-    identifier_list ':' type
-    | parameter_list ';' identifier_list ':' type
+    identifier_list ':' type {
+        // parameters are bound in the subprogram scope, frame layout is not generated yet
+        SymbolTable::getDefault()->clearIdentifierList();
+    }
+    | parameter_list ';' identifier_list ':' type {
+        SymbolTable::getDefault()->clearIdentifierList();
+    }
     ;
 
 compound_statement:
     BEGIN
     optional_statements
-    END
+    END {$$ = $2;}
     ;
 
 optional_statements:
-    statement_list
-    | %empty
+    statement_list {$$ = $1;}
+    | %empty {$$ = Ast::getDefault()->list(NodeKinds::NK_BLOCK);}
     ;
 
 statement_list:
-    statement
-    | statement_list ';' statement
+    statement {$$ = Ast::getDefault()->list(NodeKinds::NK_BLOCK, $1);}
+    | statement_list ';' statement {$$ = Ast::getDefault()->append($1, $3);}
     ;
 
 statement:
-        variable ASSIGNOP expression {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            size_t varIndex = $1;
-            size_t exprIndex = $3;
-            Symbol* var = st->at(varIndex);
-            Symbol* expr = st->at(exprIndex);
-            if(var->getVarType()==VarTypes::VT_INT && expr->getVarType()==VarTypes::VT_REAL) {
-                exprIndex = convertToInt(exprIndex);
-                expr = st->at(exprIndex);
-            } else if(var->getVarType()==VarTypes::VT_REAL && expr->getVarType()==VarTypes::VT_INT) {
-                exprIndex = convertToReal(exprIndex);
-                expr = st->at(exprIndex);
-            }
-            else if (var->getVarType()==expr->getVarType()) {
-                // no conversion needed
-            }
-            else {
-                throw std::runtime_error(
-                    fmt::format("Types not set properly in assignment {}:={}", 
-                        varTypeEnumToString(var->getVarType()),  varTypeEnumToString(expr->getVarType())
-                    )
-                );
-            }
-            std::string comment = fmt::format("{}:={}", st->at(varIndex)->getDescriptor(), st->at(exprIndex)->getDescriptor());
-            e->generateCode("mov", exprIndex, varIndex, comment);
-        }
-    |   procedure_statement
-    |   compound_statement
-    |   IF expression THEN   {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            size_t expressionIndex = $2;
-            Symbol * expression = st->at(expressionIndex);
-            if(expression->getVarType()==VarTypes::VT_REAL) {
-                expressionIndex = convertToInt(expressionIndex);
-                expression = st->at(expressionIndex);
-            }
-            std::string labelElse = fmt::format("lab{}_else", st->pushNextLabelIndex());
-            e->generateCodeConst("je", expressionIndex, "#0", fmt::format("#{}",labelElse), "");
-        } statement ELSE  {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            std::string labelElse = fmt::format("lab{}_else", st->popLabelIndex());
-            std::string labelAfter = fmt::format("lab{}_endif", st->pushNextLabelIndex());
-            e->generateRaw(fmt::format("\tjump.i #{};", labelAfter));
-            e->generateRaw(fmt::format("{}:", labelElse));
-        } statement {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            std::string labelAfter = fmt::format("lab{}_endif", st->popLabelIndex());
-            e->generateRaw(fmt::format("{}:", labelAfter));
-        }
-    |   WHILE expression {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            std::string labelEndWhile = fmt::format("lab{}_endwhile", st->pushNextLabelIndex());
-            std::string labelWhile = fmt::format("lab{}_while", st->pushNextLabelIndex());
-            size_t expressionIndex = $2;
-            Symbol * expression = st->at(expressionIndex);
-            if(expression->getVarType()==VarTypes::VT_REAL) {
-                expressionIndex = convertToInt(expressionIndex);
-                expression = st->at(expressionIndex);
-            }
-            e->generateRaw(fmt::format("{}:", labelWhile));
-            e->generateCodeConst("je", expressionIndex, "#0", fmt::format("#{}",labelEndWhile), "");
-        } DO statement {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            std::string labelWhile = fmt::format("lab{}_while", st->popLabelIndex());
-            std::string labelEndWhile = fmt::format("lab{}_endwhile", st->popLabelIndex());
-            e->generateRaw(fmt::format("\tjump.i #{};", labelWhile));
-            e->generateRaw(fmt::format("{}:", labelEndWhile));
-
-        }
-    |   WRITE '(' expression ')' {
-            SymbolTable *st = SymbolTable::getDefault();
-            std::string comment = fmt::format("write({})", st->at($3)->getDescriptor());
-            Emitter::getDefault()->generateCode("write", $3, comment); 
-        }
+        variable ASSIGNOP expression {$$ = Ast::getDefault()->assign($1, $3);}
+    |   procedure_statement {$$ = $1;}
+    |   compound_statement {$$ = $1;}
+    |   IF expression THEN statement ELSE statement {$$ = Ast::getDefault()->ifElse($2, $4, $6);}
+    |   WHILE expression DO statement {$$ = Ast::getDefault()->whileLoop($2, $4);}
+    |   WRITE '(' expression ')' {$$ = Ast::getDefault()->write($3);}
     ;
 
 variable:
-        ID {$$ = $1;}
-    |   ID '[' expression ']' {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            size_t expressionIndex = $3;
-            size_t arrayIndex = $1;
-            Symbol* expression = st->at(expressionIndex);
-            Symbol* array = st->at(arrayIndex);
-            if(!array->isArray()) {
-                throw std::runtime_error(fmt::format("{} is not an array.", array->getDescriptor()));
-            }
-            if(expression->getVarType() != VarTypes::VT_INT) { // convert to int maybe?
-                throw std::runtime_error(fmt::format("Array index must be integer."));
-            }
-            std::string comment = fmt::format("{}[{}]", array->getDescriptor(), expression->getDescriptor());
-            size_t arrayIndexTemp = st->getNewTemporaryVariable(VarTypes::VT_INT, comment); 
-            size_t arrayStart = std::get<0>(array->getArrayBounds());
-            int varSize = varTypeToSize(array->getVarType());
-            comment = fmt::format("CALC_ARRAY_OFFSET({}-{})", expression->getDescriptor(), arrayStart);
-            e->generateCodeConst("sub", expressionIndex, fmt::format("#{}", arrayStart), arrayIndexTemp, comment);
-            comment = fmt::format("CALC_ARRAY_OFFSET(({}-{})*{})", expression->getDescriptor(), arrayStart, varSize);
-            e->generateCodeConst("mul", arrayIndexTemp, fmt::format("#{}", varSize), arrayIndexTemp, comment);
-            comment = fmt::format("{}[{}]", array->getDescriptor(), expression->getDescriptor());
-            e->generateCodeConst("add", arrayIndexTemp, fmt::format("#{}", array->getAddress()), arrayIndexTemp, comment);
-            st->at(arrayIndexTemp)->setIsReference(true);
-            st->at(arrayIndexTemp)->setVarType(array->getVarType()); // change to double if needed
-            $$ = arrayIndexTemp;
-        }
+        ID {$$ = Ast::getDefault()->symbol($1);}
+    |   ID '[' expression ']' {$$ = Ast::getDefault()->index($1, $3);}
     ;
 
 procedure_statement:
-        ID
-    |   ID '(' expression_list ')'
+        ID {$$ = Ast::getDefault()->call($1);}
+    |   ID '(' expression_list ')' {$$ = Ast::getDefault()->call($1, $3);}
     ;
 
 expression_list:
-        expression {$$ = $1;}
-    |   expression_list ',' expression
+        expression {$$ = Ast::getDefault()->list(NodeKinds::NK_LIST, $1);}
+    |   expression_list ',' expression {$$ = Ast::getDefault()->append($1, $3);}
     ;
 
 expression:
         simple_expression {$$ = $1;}
-    |   simple_expression relop simple_expression {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            size_t e1i = $1;
-            size_t e2i = $3;
-            Symbol * e1 = st->at(e1i);
-            Symbol * e2 = st->at(e2i);
-            bool isTempReal = isResultReal(e1,e2);
-            if(isTempReal) {
-                if(e1->getVarType()==VarTypes::VT_INT) {
-                    e1i = convertToReal(e1i);
-                    e1 = st->at(e1i);
-                }
-                else if(e2->getVarType()==VarTypes::VT_INT) {
-                    e2i = convertToReal(e2i);
-                    e2 = st->at(e2i);
-                }
-                else if(e1->getVarType()==VarTypes::VT_REAL && e2->getVarType()==VarTypes::VT_REAL) {
-                    // all good 
-                }
-                else {   
-                    throw std::runtime_error(fmt::format("Unknown type conversion in {}{}{}", e1->getDescriptor(), operatorTokenToString($2), e2->getDescriptor()));
-                }
-            }
-            std::string tempDescriptor = fmt::format("{}{}{}", e1->getDescriptor(), operatorTokenToString($2), e2->getDescriptor());
-            size_t opResultIndex = st->getNewTemporaryVariable(VarTypes::VT_INT,  tempDescriptor);
-            std::string labelTrue = fmt::format("lab{}_true", st->getNextLabelIndex());
-            std::string trueHash = fmt::format("#{}", labelTrue);
-            std::string labelAfter = fmt::format("lab{}_end", st->getNextLabelIndex());
-            switch($2) {
-                case '=':
-                    e->generateCodeConst("je", e1i, e2i, trueHash, "");
-                break;
-                case '>': 
-                    e->generateCodeConst("jg", e1i, e2i, trueHash, "");
-                break;
-                case '<': 
-                    e->generateCodeConst("jl", e1i, e2i, trueHash, "");
-                break;
-                case TOK_NEQ: 
-                    e->generateCodeConst("jne", e1i, e2i, trueHash,"");
-                break;
-                case TOK_GE: 
-                    e->generateCodeConst("jge", e1i, e2i, trueHash,"");
-                break;
-                case TOK_LE: 
-                    e->generateCodeConst("jle", e1i, e2i, trueHash,"");
-                break;
-            }
-            e->generateCodeConst("mov", "#0", opResultIndex, "");
-            e->generateRaw(fmt::format("\tjump.i #{};", labelAfter));
-            e->generateRaw(fmt::format("{}:", labelTrue));
-            e->generateCodeConst("mov", "#1", opResultIndex, "");
-            e->generateRaw(fmt::format("{}:", labelAfter));
-            $$ = opResultIndex;
-
-        }
+    |   simple_expression relop simple_expression {$$ = Ast::getDefault()->binary(NodeKinds::NK_RELATION, $2, $1, $3);}
     ;
 
 relop:
@@ -352,63 +212,13 @@ simple_expression:
         term {$$ = $1;}
     |   sign term {
             if($1=='-') {
-                SymbolTable *st = SymbolTable::getDefault();
-                Emitter *e = Emitter::getDefault();
-                Symbol* original = st->at($2);
-                size_t negResult = st->getNewTemporaryVariable(original->getVarType());
-                std::string comment = fmt::format("-{}", st->at($2)->getDescriptor());
-                e->subFromZero($2, negResult);
-                $$ = negResult;
+                $$ = Ast::getDefault()->unary(NodeKinds::NK_NEGATE, $2);
             }
             else { // '+'
                 $$ = $2;
             }
         }
-    |   simple_expression exprop term {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            Symbol* exp = st->at($1);
-            Symbol* trm = st->at($3);
-            size_t expressionIndex = $1;
-            size_t termIndex = $3;
-            bool isTempReal = isResultReal(exp,trm);
-            if(isTempReal) {
-                if(exp->getVarType()==VarTypes::VT_INT) {
-                    expressionIndex = convertToReal(expressionIndex);
-                    exp = st->at(expressionIndex);
-                }
-                else if(trm->getVarType()==VarTypes::VT_INT) {
-                    termIndex = convertToReal(termIndex);
-                    trm = st->at(termIndex);
-                }
-                else if(exp->getVarType()==VarTypes::VT_REAL && trm->getVarType()==VarTypes::VT_REAL) {
-                    // all good 
-                }
-                else {   
-                    throw std::runtime_error(fmt::format("Unknown type conversion in {}{}{}", exp->getDescriptor(), operatorTokenToString($2), trm->getDescriptor()));
-                }
-            }
-            std::string tempDescriptor = fmt::format("{}{}{}", exp->getDescriptor(), operatorTokenToString($2), trm->getDescriptor());
-            size_t opResult = st->getNewTemporaryVariable(isTempReal ? VarTypes::VT_REAL : VarTypes::VT_INT,  tempDescriptor);
-            switch($2) {
-                case '-':
-                    e->generateCode("sub", expressionIndex, termIndex, opResult, tempDescriptor);
-                break;
-                case '+':
-                    e->generateCode("add", expressionIndex, termIndex, opResult, tempDescriptor);
-                break;
-                case TOK_OR:
-                    e->generateCode("or",  expressionIndex, termIndex, opResult, tempDescriptor);
-                break;
-                case TOK_AND:
-                    e->generateCode("and", expressionIndex, termIndex, opResult, tempDescriptor);
-                break;
-                default:
-                    throw std::runtime_error(fmt::format("Unknown operation {}.", $2));
-                break;
-            }
-            $$ = opResult;
-        }
+    |   simple_expression exprop term {$$ = Ast::getDefault()->binary(NodeKinds::NK_BINARY, $2, $1, $3);}
     ;
 
 exprop:
@@ -424,40 +234,7 @@ sign:
 
 term:
         factor {$$ = $1;}
-    |   term mulop factor {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            size_t termIndex = $1;
-            size_t factorIndex = $3;
-            Symbol* trm = st->at(termIndex);
-            Symbol* fac = st->at(factorIndex);
-            bool isTempReal = isResultReal(trm,fac);
-            if(isTempReal) {
-                if(trm->getVarType()==VarTypes::VT_INT) {
-                    termIndex = convertToReal(termIndex);
-                    trm = st->at(termIndex);
-                }
-                else if(fac->getVarType()==VarTypes::VT_INT) {
-                    factorIndex = convertToReal(factorIndex);
-                    fac = st->at(factorIndex);
-                }
-            }
-            std::string tempDescriptor = fmt::format("{}{}{}", trm->getDescriptor(), operatorTokenToString($2), fac->getDescriptor());
-            size_t opResult = st->getNewTemporaryVariable(isTempReal?VarTypes::VT_REAL:VarTypes::VT_INT,  tempDescriptor);
-            switch($2) {
-                case '*':
-                    e->generateCode("mul", termIndex, factorIndex, opResult, tempDescriptor);
-                break;
-                case '/': case TOK_DIV:
-                    e->generateCode("div", termIndex, factorIndex, opResult, tempDescriptor);
-                break;
-                case TOK_MOD: case '%':
-                    e->generateCode("mod", termIndex, factorIndex, opResult, tempDescriptor);
-                break;
-            }
-            $$ = opResult;
-        }
-    
+    |   term mulop factor {$$ = Ast::getDefault()->binary(NodeKinds::NK_BINARY, $2, $1, $3);}
     ;
 
 mulop:
@@ -470,40 +247,16 @@ mulop:
 
 factor:
         variable {$$ = $1;}
-    |   ID '(' expression_list ')'
-    |   NUM {$$ = $1;}
+    |   ID '(' expression_list ')' {$$ = Ast::getDefault()->call($1, $3);}
+    |   NUM {$$ = Ast::getDefault()->symbol($1);}
     |   '(' expression ')' {
             $$ = $2;
         }
-    |   NOT factor {
-            SymbolTable *st = SymbolTable::getDefault();
-            Emitter *e = Emitter::getDefault();
-            size_t factorIndex = $2;
-            Symbol * factor = st->at(factorIndex);
-            if(factor->getVarType()==VarTypes::VT_REAL) {
-                factorIndex = convertToInt(factorIndex);
-                factor = st->at(factorIndex);
-            }
-            size_t opResultIndex = st->getNewTemporaryVariable(VarTypes::VT_INT,  fmt::format("!{}", factor->getDescriptor()));
-            std::string labelTrue = fmt::format("lab{}_totrue", st->getNextLabelIndex());
-            std::string trueHash = fmt::format("#{}", labelTrue);
-            std::string labelAfter = fmt::format("lab{}_end", st->getNextLabelIndex());
-            e->generateCodeConst("je", factorIndex, "#0", trueHash, "");
-            e->generateCodeConst("mov", "#0", opResultIndex, "");
-            e->generateRaw(fmt::format("\tjump.i #{}", labelAfter));
-            e->generateRaw(fmt::format("{}:", labelTrue));
-            e->generateCodeConst("mov", "#1", opResultIndex, "");
-            e->generateRaw(fmt::format("{}:", labelAfter));
-            $$ = opResultIndex;
-        }
+    |   NOT factor {$$ = Ast::getDefault()->unary(NodeKinds::NK_NOT, $2);}
     ;
 
 %%
-bool isResultReal(Symbol * s1, Symbol *s2)
-{
-    return (s1->getVarType() | s2->getVarType()) & VarTypes::VT_REAL;
-}
-std::string operatorTokenToString(address_t token)
+const char* operatorTokenToString(address_t token)
 {
     switch(token)
     {
@@ -525,25 +278,23 @@ std::string operatorTokenToString(address_t token)
         default: return "<UNNKOWNOPSTRING>";
     }
 }
-size_t convertToReal(size_t stIndex, SymbolTable* st, Emitter * e)
+Opcodes operatorTokenToOpcode(address_t token)
 {
-    if(!e) e = Emitter::getDefault();
-    if(!st) st = SymbolTable::getDefault();
-    Symbol * toConvert = st->at(stIndex);
-    std::string comment = fmt::format("real({})", toConvert->getDescriptor());
-    if(toConvert->getVarType() != VarTypes::VT_INT) throw std::runtime_error(fmt::format("Tried to convert nonint {} to real.", toConvert->getAttribute()));
-    size_t convertedIndex = st->getNewTemporaryVariable(VarTypes::VT_REAL, comment);
-    e->generateCode("inttoreal", stIndex, convertedIndex, comment);
-    return convertedIndex;
+    switch(token)
+    {
+        case TOK_OR :   return Opcodes::OP_OR;
+        case TOK_AND:   return Opcodes::OP_AND;
+        case TOK_LE :   return Opcodes::OP_JLE;
+        case TOK_GE :   return Opcodes::OP_JGE;
+        case '<' :      return Opcodes::OP_JL;
+        case '>' :      return Opcodes::OP_JG;
+        case TOK_NEQ:   return Opcodes::OP_JNE;
+        case '=' :      return Opcodes::OP_JE;
+        case '*':       return Opcodes::OP_MUL;
+        case '/': case TOK_DIV: return Opcodes::OP_DIV;
+        case '%': case TOK_MOD: return Opcodes::OP_MOD;
+        case '+':       return Opcodes::OP_ADD;
+        case '-':       return Opcodes::OP_SUB;
+        default: throw std::runtime_error(fmt::format("Unknown operation {}.", token));
+    }
 }
-size_t convertToInt(size_t stIndex, SymbolTable* st, Emitter * e)
-{
-    if(!e) e = Emitter::getDefault();
-    if(!st) st = SymbolTable::getDefault();
-    Symbol * toConvert = st->at(stIndex);
-    std::string comment = fmt::format("int({})", toConvert->getDescriptor());
-    if(toConvert->getVarType() != VarTypes::VT_REAL) throw std::runtime_error(fmt::format("Tried to convert nonreal {} to int.", toConvert->getAttribute()));
-    size_t convertedIndex = st->getNewTemporaryVariable(VarTypes::VT_INT, comment);
-    e->generateCode("realtoint", stIndex, convertedIndex, comment);
-    return convertedIndex;
-}
\ No newline at end of file
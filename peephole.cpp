@@ -0,0 +1,260 @@
+#include "peephole.hpp"
+#include "symboltable.hpp"
+#include "trace.hpp"
+#include <cstdint>
+
+namespace {
+// Operand slots of a shape hold a variable number, bound by the first
+// operand they meet and compared with the later ones, or one of these.
+const int8_t ANY = -1;
+const int8_t ZERO = -2; // the integer constant 0
+const int8_t ONE = -3;  // the integer constant 1
+// Opcode of a shape that matches any of je .. jle.
+const uint8_t CONDITIONAL_JUMP = Opcodes::OP_COUNT;
+const size_t MAX_WINDOW = 7;
+const size_t VARIABLE_COUNT = 4;
+
+struct Shape {
+    uint8_t op;
+    int8_t operands[3];
+    int8_t label; // variable of the jump target or of the label defined
+};
+struct Match {
+    Instruction* window;
+    size_t length;
+    operand_t operands[VARIABLE_COUNT];
+    uint32_t labels[VARIABLE_COUNT];
+};
+// Checks what the shapes cannot express and rewrites the window in place.
+// Returns how many instructions the window keeps, or -1 to leave it be.
+typedef int (*Rewrite)(Match& match, Peephole::Chunk& chunk);
+struct Rule {
+    const char* name;
+    size_t length;
+    Shape shapes[MAX_WINDOW];
+    Rewrite rewrite;
+};
+
+bool isConditionalJump(Opcodes op)
+{
+    return op >= Opcodes::OP_JE && op <= Opcodes::OP_JLE;
+}
+// Labels of one relation or not, referenced only before their definition
+// and within the same chunk.
+bool isExpressionLabel(LabelKinds kind)
+{
+    return kind == LabelKinds::LK_TRUE || kind == LabelKinds::LK_TOTRUE || kind == LabelKinds::LK_END;
+}
+bool isIntegerConstant(operand_t operand, int64_t value)
+{
+    SymbolTable *st = SymbolTable::getDefault();
+    if(Instruction::isIndirect(operand)) return false;
+    Symbol* s = st->at(Instruction::symbolOf(operand));
+    return s->getSymbolType() == SymbolTypes::ST_NUM && s->getVarType() == VarTypes::VT_INT
+        && st->getIntegerConstant(Instruction::symbolOf(operand)) == value;
+}
+Opcodes invertCondition(Opcodes op)
+{
+    switch(op)
+    {
+        case Opcodes::OP_JE: return Opcodes::OP_JNE;
+        case Opcodes::OP_JNE: return Opcodes::OP_JE;
+        case Opcodes::OP_JG: return Opcodes::OP_JLE;
+        case Opcodes::OP_JLE: return Opcodes::OP_JG;
+        case Opcodes::OP_JGE: return Opcodes::OP_JL;
+        default: return Opcodes::OP_JGE;
+    }
+}
+
+// jump.i #L; L:
+int dropJump(Match& match, Peephole::Chunk& chunk)
+{
+    chunk.labelReferences[match.labels[0]]--;
+    match.window[0] = match.window[1];
+    return 1;
+}
+// mov a, a
+int dropMov(Match& match, Peephole::Chunk& chunk)
+{
+    return 0;
+}
+// mov a, b; mov b, a
+int dropMovBack(Match& match, Peephole::Chunk& chunk)
+{
+    if(match.window[0].type != match.window[1].type) return -1;
+    return 1;
+}
+// jcc a, b, #Ltrue; mov #0, t; jump #Lend; Ltrue: mov #1, t; Lend: je t, #0, #L
+int testCondition(Match& match, Peephole::Chunk& chunk)
+{
+    Instruction* window = match.window;
+    Instruction test = window[6];
+    size_t temporary = Instruction::symbolOf(match.operands[2]);
+    if(test.op != Opcodes::OP_JE && test.op != Opcodes::OP_JNE) return -1;
+    if(Instruction::isIndirect(match.operands[2]) || !SymbolTable::getDefault()->at(temporary)->isTemporary()) return -1;
+    if(chunk.temporaryReads[temporary] != 1) return -1;
+    if(!isExpressionLabel(window[3].labelKind) || !isExpressionLabel(window[5].labelKind)) return -1;
+    if(chunk.labelReferences[match.labels[0]] != 1 || chunk.labelReferences[match.labels[1]] != 1) return -1;
+    chunk.temporaryReads[temporary] = 0;
+    chunk.labelReferences[match.labels[1]] = 0;
+    if(test.op == Opcodes::OP_JNE) {
+        // jump straight where the condition holds
+        chunk.labelReferences[match.labels[0]] = 0;
+        window[0].label = test.label;
+        window[0].labelKind = test.labelKind;
+        return 1;
+    }
+    // jump past where the condition fails
+    Instruction jump = test;
+    jump.op = Opcodes::OP_JUMP;
+    jump.type = VarTypes::VT_INT;
+    jump.operandCount = 0;
+    jump.comment = NO_COMMENT;
+    window[1] = jump;
+    window[2] = window[3];
+    return 3;
+}
+// jcc a, b, #L; jump #M; L:
+int invertJump(Match& match, Peephole::Chunk& chunk)
+{
+    Instruction* window = match.window;
+    // a real comparison and its inverse are both false on NaN
+    if(window[0].type != VarTypes::VT_INT) return -1;
+    chunk.labelReferences[match.labels[0]]--;
+    window[0].op = invertCondition(window[0].op);
+    window[0].label = window[1].label;
+    window[0].labelKind = window[1].labelKind;
+    window[1] = window[2];
+    return 2;
+}
+// L: with no jump to it left
+int dropLabel(Match& match, Peephole::Chunk& chunk)
+{
+    if(!isExpressionLabel(match.window[0].labelKind) || chunk.labelReferences[match.labels[0]] != 0) return -1;
+    return 0;
+}
+
+const Rule RULES[] = {
+    {"jump to the next label", 2, {
+        {Opcodes::OP_JUMP, {ANY, ANY, ANY}, 0},
+        {Opcodes::OP_LABEL, {ANY, ANY, ANY}, 0}}, dropJump},
+    {"mov to itself", 1, {
+        {Opcodes::OP_MOV, {0, 0, ANY}, ANY}}, dropMov},
+    {"mov back", 2, {
+        {Opcodes::OP_MOV, {0, 1, ANY}, ANY},
+        {Opcodes::OP_MOV, {1, 0, ANY}, ANY}}, dropMovBack},
+    {"materialized boolean test", 7, {
+        {CONDITIONAL_JUMP, {0, 1, ANY}, 0},
+        {Opcodes::OP_MOV, {ZERO, 2, ANY}, ANY},
+        {Opcodes::OP_JUMP, {ANY, ANY, ANY}, 1},
+        {Opcodes::OP_LABEL, {ANY, ANY, ANY}, 0},
+        {Opcodes::OP_MOV, {ONE, 2, ANY}, ANY},
+        {Opcodes::OP_LABEL, {ANY, ANY, ANY}, 1},
+        {CONDITIONAL_JUMP, {2, ZERO, ANY}, ANY}}, testCondition},
+    {"conditional jump over a jump", 3, {
+        {CONDITIONAL_JUMP, {0, 1, ANY}, 0},
+        {Opcodes::OP_JUMP, {ANY, ANY, ANY}, ANY},
+        {Opcodes::OP_LABEL, {ANY, ANY, ANY}, 0}}, invertJump},
+    {"unused label", 1, {
+        {Opcodes::OP_LABEL, {ANY, ANY, ANY}, 0}}, dropLabel},
+};
+const size_t RULE_COUNT = sizeof(RULES) / sizeof(RULES[0]);
+
+bool matches(const Rule& rule, Instruction* window, Match& match)
+{
+    bool operandBound[VARIABLE_COUNT] = {};
+    bool labelBound[VARIABLE_COUNT] = {};
+    match.window = window;
+    match.length = rule.length;
+    for(size_t i = 0; i < rule.length; i++)
+    {
+        const Shape& shape = rule.shapes[i];
+        const Instruction& ins = window[i];
+        if(shape.op == CONDITIONAL_JUMP ? !isConditionalJump(ins.op) : ins.op != shape.op) return false;
+        for(uint8_t k = 0; k < ins.operandCount; k++)
+        {
+            int8_t slot = shape.operands[k];
+            if(slot == ANY) continue;
+            if(slot == ZERO || slot == ONE) {
+                if(!isIntegerConstant(ins.operands[k], slot == ZERO ? 0 : 1)) return false;
+                continue;
+            }
+            if(!operandBound[slot]) {
+                operandBound[slot] = true;
+                match.operands[slot] = ins.operands[k];
+            }
+            else if(match.operands[slot] != ins.operands[k]) return false;
+        }
+        if(shape.label == ANY) continue;
+        if(!labelBound[shape.label]) {
+            labelBound[shape.label] = true;
+            match.labels[shape.label] = ins.label;
+        }
+        else if(match.labels[shape.label] != ins.label) return false;
+    }
+    return true;
+}
+}
+
+Peephole::Peephole() : hits(RULE_COUNT, 0)
+{
+}
+void Peephole::run(IR& ir)
+{
+    this->chunk.labelReferences.clear();
+    this->chunk.temporaryReads.clear();
+    for(size_t i = 0; i < ir.size(); i++)
+    {
+        const Instruction& ins = ir[i];
+        if(ins.op != Opcodes::OP_LABEL && ins.hasLabel()) this->chunk.labelReferences[ins.label]++;
+        for(uint8_t k = 0; k < ins.readOperandCount(); k++)
+        {
+            size_t index = Instruction::symbolOf(ins.operands[k]);
+            if(SymbolTable::isTemporary(index)) this->chunk.temporaryReads[index]++;
+        }
+    }
+    size_t out = 0;
+    for(size_t in = 0; in < ir.size(); in++)
+    {
+        ir[out++] = ir[in];
+        // rewrites only shrink the window, so the rebuilt part never
+        // overtakes the instructions still to be read
+        size_t rule = 0;
+        while(rule < RULE_COUNT)
+        {
+            Match match;
+            if(RULES[rule].length > out || !matches(RULES[rule], &ir[out - RULES[rule].length], match)) {
+                rule++;
+                continue;
+            }
+            int kept = RULES[rule].rewrite(match, this->chunk);
+            if(kept < 0) {
+                rule++;
+                continue;
+            }
+            this->hits[rule]++;
+            out = out - RULES[rule].length + kept;
+            rule = 0;
+        }
+    }
+    ir.truncate(out);
+}
+size_t Peephole::ruleCount() const
+{
+    return RULE_COUNT;
+}
+const char* Peephole::ruleName(size_t rule) const
+{
+    return RULES[rule].name;
+}
+uint64_t Peephole::getHits(size_t rule) const
+{
+    return this->hits[rule];
+}
+void Peephole::traceHits() const
+{
+    for(size_t rule = 0; rule < RULE_COUNT; rule++)
+    {
+        TRACE(TC_OPT, TL_INFO, "peephole {:>8} {}\n", this->hits[rule], RULES[rule].name);
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include "ir.hpp"
+// Peephole optimizer, run by the emitter from -O1 on each chunk of IR just
+// before it is lowered. The chunk is rebuilt in place one instruction at a
+// time, and after every step the rules of a pattern table are matched
+// against the last instructions rebuilt, so whatever a rewrite leaves is
+// matched again. Each rule counts its hits; --trace=opt prints them at
+// the end of the program.
+class Peephole {
+public:
+    // What the rules may ask about the chunk besides their window.
+    struct Chunk {
+        std::unordered_map<uint32_t, uint32_t> labelReferences;
+        std::unordered_map<size_t, uint32_t> temporaryReads;
+    };
+private:
+    std::vector<uint64_t> hits;
+    Chunk chunk;
+public:
+    Peephole();
+    void run(IR& ir);
+    size_t ruleCount() const;
+    const char* ruleName(size_t rule) const;
+    uint64_t getHits(size_t rule) const;
+    void traceHits() const;
+};
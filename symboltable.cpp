@@ -1,6 +1,10 @@
 #include "symboltable.hpp"
+#include "trace.hpp"
 #include <fmt/format.h>
 #include <exception>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
 std::string varTypeEnumToString(VarTypes t)
 {
     switch(t)
@@ -33,25 +37,17 @@ int varTypeToSize(VarTypes t, size_t arraySize)
     if(arraySize) memorySize*=arraySize;
     return memorySize;
 }
-Symbol::Symbol(std::string attr, SymbolTypes type) : attribute(attr), symbolType(type) 
+Symbol::Symbol(SymbolTypes type) : symbolType(type)
 {
 
 }
-Symbol::Symbol(std::string attr, SymbolTypes stype, VarTypes vtype): attribute(attr), symbolType(stype), varType(vtype)
+Symbol::Symbol(SymbolTypes stype, VarTypes vtype): varType(vtype), symbolType(stype)
 {
 
 }
-Symbol::Symbol(std::string attr, SymbolTypes stype, VarTypes vtype, address_t address): attribute(attr), symbolType(stype), varType(vtype), address(address)
+Symbol::Symbol(SymbolTypes stype, VarTypes vtype, address_t address): address(address), varType(vtype), symbolType(stype)
 {
 
-}
-Symbol::~Symbol()
-{
-
-}
-void Symbol::setArrayBounds(std::tuple<size_t, size_t> bounds)
-{
-    this->arrayBounds = bounds;
 }
 bool Symbol::isInMemory()
 {
@@ -62,54 +58,60 @@ void Symbol::placeInMemory(VarTypes type, address_t address)
     this->varType = type;
     this->address = address;
 }
-const std::string Symbol::getAttribute()
-{
-    return this->attribute;
-}
 address_t Symbol::getAddress()
 {
     return this->address;
 }
 SymbolTypes Symbol::getSymbolType()
 {
-    return this->symbolType;
+    return (SymbolTypes)this->symbolType;
 }
 VarTypes Symbol::getVarType()
 {
-    return this->varType;
+    return (VarTypes)this->varType;
 }
-std::string Symbol::getDescriptor()
-{
-    if(this->descriptor.empty()){
-        return this->attribute;
-    }
-    else {
-        return this->descriptor;
-    }
-}
-void Symbol::setDescriptor(std::string desc)
+bool Symbol::isArray()
 {
-    this->descriptor = desc;
+    return this->flags & Flags::SF_ARRAY;
 }
-bool Symbol::isArray()
+void Symbol::setIsArray(bool array)
 {
-    return (std::get<0>(this->arrayBounds) != 0) || (std::get<1>(this->arrayBounds) != 0);
+    if(array) this->flags |= Flags::SF_ARRAY;
+    else this->flags &= ~Flags::SF_ARRAY;
 }
 void Symbol::setIsReference(bool ref)
 {
-    this->isReference = ref;
+    if(ref) this->flags |= Flags::SF_REFERENCE;
+    else this->flags &= ~Flags::SF_REFERENCE;
 }
 bool Symbol::getIsReference()
 {
-    return this->isReference;
+    return this->flags & Flags::SF_REFERENCE;
 }
-void Symbol::setVarType(VarTypes vt)
+void Symbol::markTemporary(bool wideSlot)
 {
-    this->varType = vt;
+    this->flags |= Flags::SF_TEMPORARY;
+    if(wideSlot) this->flags |= Flags::SF_WIDE_SLOT;
 }
-std::tuple<size_t, size_t> Symbol::getArrayBounds()
+bool Symbol::isLiveTemporary()
 {
-    return this->arrayBounds;
+    return (this->flags & (Flags::SF_TEMPORARY | Flags::SF_RELEASED)) == Flags::SF_TEMPORARY;
+}
+bool Symbol::isTemporary()
+{
+    return this->flags & Flags::SF_TEMPORARY;
+}
+bool Symbol::hasWideSlot()
+{
+    return this->flags & Flags::SF_WIDE_SLOT;
+}
+void Symbol::markReleased()
+{
+    this->flags |= Flags::SF_RELEASED;
+}
+void Symbol::setVarType(VarTypes vt)
+{
+    this->varType = vt;
 }
 
 SymbolTable* SymbolTable::instance = nullptr;
@@ -136,21 +138,46 @@ SymbolTable* SymbolTable::getDefault()
 {
     return SymbolTable::instance;
 }
-bool SymbolTable::tryGetSymbolIndex(std::string s, size_t& index)
+void SymbolTable::reserveForInputSize(size_t bytes)
 {
-    if(this->symbols.size() == 0) return false;
-    for(size_t i = this->symbols.size()-1; i >= 0; i--)
-    {
-        if(this->at(i)->getAttribute() == s)
-        {
-            index = i;
-            return true;
-        }
-        if(i==0) break;
+    // roughly one symbol (identifier, constant or temporary) per 8 bytes of source
+    this->symbols.reserve(bytes/8);
+    this->symbolNames.reserve(bytes/8);
+    this->symbolShadowed.reserve(bytes/8);
+    this->symbolScopes.reserve(bytes/8);
+    this->temporaries.reserve(bytes/8);
+    this->temporaryDescriptors.reserve(bytes/8);
+    this->atoms.reserve(bytes/8, bytes/2);
+}
+bool SymbolTable::tryGetSymbolIndex(atom_t atom, size_t& index)
+{
+    if(atom >= this->atomSymbols.size() || this->atomSymbols[atom] == (size_t)-1) return false;
+    index = this->atomSymbols[atom];
+    return true;
+}
+bool SymbolTable::tryGetSymbolIndex(std::string_view s, size_t& index)
+{
+    atom_t atom;
+    if(!this->atoms.tryGetAtom(s.data(), s.size(), atom)) return false;
+    return this->tryGetSymbolIndex(atom, index);
+}
+size_t SymbolTable::pushSymbol(Symbol s, uint32_t name)
+{
+    size_t index = this->symbols.emplace_back(s);
+    this->symbolNames.push_back(name);
+    this->symbolScopes.push_back((uint32_t)this->getScopeDepth());
+    if(s.getSymbolType() == SymbolTypes::ST_ID) {
+        if(name >= this->atomSymbols.size()) this->atomSymbols.resize(name+1, (size_t)-1);
+        this->symbolShadowed.push_back(this->atomSymbols[name]);
+        this->atomSymbols[name] = index;
+        if(!this->scopeMarks.empty()) this->scopeBindings.push_back(index);
     }
-    return false;
+    else {
+        this->symbolShadowed.push_back((size_t)-1);
+    }
+    return index;
 }
-size_t SymbolTable::getSymbolIndex(std::string s)
+size_t SymbolTable::getSymbolIndex(std::string_view s)
 {
     size_t i = -1;
     if(this->tryGetSymbolIndex(s, i)) {
@@ -162,83 +189,296 @@ size_t SymbolTable::getSymbolIndex(std::string s)
     }
 
 }
-size_t SymbolTable::insertOrGetSymbolIndex(std::string s)
+size_t SymbolTable::insertOrGetSymbolIndex(const char* text, size_t length)
 {
     size_t i = -1;
-    if(this->tryGetSymbolIndex(s, i)) {
+    atom_t atom = this->atoms.intern(text, length);
+    if(this->tryGetSymbolIndex(atom, i)) {
         return i;
-        fmt::print("Returning symbol '{}' at {}\n", s, i);
     }
     else {
-        fmt::print("Pushing symbol '{}' at {}\n", s, this->symbols.size());
-        this->symbols.push_back(Symbol(s, SymbolTypes::ST_ID));
-        return this->symbols.size()-1;
+        TRACE(TC_SYMTAB, TL_DEBUG, "Pushing symbol '{}' at {}\n", fmt::string_view(text, length), this->symbols.size());
+        return this->pushSymbol(Symbol(SymbolTypes::ST_ID), atom);
     }
 }
-size_t SymbolTable::insertOrGetNumericalConstant(std::string s)
+size_t SymbolTable::insertOrGetSymbolIndex(std::string_view s)
 {
-    size_t i = -1;
-    VarTypes type;
-    if (s.find(".") != std::string::npos) {
-        type = VarTypes::VT_REAL;
+    return this->insertOrGetSymbolIndex(s.data(), s.size());
+}
+size_t SymbolTable::insertOrGetIntegerConstant(const char* text, size_t length)
+{
+    int64_t value = 0;
+    for(size_t i = 0; i < length; i++)
+    {
+        if(value > (INT64_MAX - (text[i]-'0')) / 10) {
+            throw std::runtime_error(fmt::format("Integer constant {} is out of range.", fmt::string_view(text, length)));
+        }
+        value = value*10 + (text[i]-'0');
     }
-    else {
-        type = VarTypes::VT_INT;
+    return this->insertOrGetIntegerConstant(value);
+}
+size_t SymbolTable::insertOrGetRealConstant(const char* text, size_t length)
+{
+    char buffer[64];
+    if(length >= sizeof(buffer)) {
+        return this->insertOrGetRealConstant(std::strtod(std::string(text, length).c_str(), nullptr));
     }
+    std::memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    return this->insertOrGetRealConstant(std::strtod(buffer, nullptr));
+}
+size_t SymbolTable::insertOrGetIntegerConstant(int64_t value)
+{
+    bool inserted;
+    constant_t c = this->constants.insertOrGetInteger(value, inserted);
+    if(!inserted) return this->constants.getSymbolIndex(c);
+    TRACE(TC_SYMTAB, TL_DEBUG, "Pushing numeric constant '{}' of type {} at {}\n", this->constants.getSpelling(c), varTypeEnumToString(VarTypes::VT_INT), this->symbols.size());
+    size_t index = this->pushSymbol(Symbol(SymbolTypes::ST_NUM, VarTypes::VT_INT), c);
+    this->constants.setSymbolIndex(c, index);
+    return index;
+}
+size_t SymbolTable::insertOrGetRealConstant(double value)
+{
+    bool inserted;
+    constant_t c = this->constants.insertOrGetReal(value, inserted);
+    if(!inserted) return this->constants.getSymbolIndex(c);
+    TRACE(TC_SYMTAB, TL_DEBUG, "Pushing numeric constant '{}' of type {} at {}\n", this->constants.getSpelling(c), varTypeEnumToString(VarTypes::VT_REAL), this->symbols.size());
+    size_t index = this->pushSymbol(Symbol(SymbolTypes::ST_NUM, VarTypes::VT_REAL), c);
+    this->constants.setSymbolIndex(c, index);
+    return index;
+}
+int64_t SymbolTable::getIntegerConstant(size_t index)
+{
+    if(this->at(index)->getSymbolType() != SymbolTypes::ST_NUM) throw std::runtime_error(fmt::format("{} is not a constant.", this->getAttribute(index)));
+    constant_t c = this->symbolNames[index];
+    return this->constants.getInteger(c);
+}
+double SymbolTable::getRealConstant(size_t index)
+{
+    if(this->at(index)->getSymbolType() != SymbolTypes::ST_NUM) throw std::runtime_error(fmt::format("{} is not a constant.", this->getAttribute(index)));
+    constant_t c = this->symbolNames[index];
+    return this->constants.getReal(c);
+}
+Label SymbolTable::getNextLabelIndex(LabelKinds kind)
+{
+    return Label{this->nextLabel++, kind};
+}
 
-    if(this->tryGetSymbolIndex(s, i)) {
-        return i;
-        fmt::print("Returning numeric constant '{}' of type {} at {}\n", s, varTypeEnumToString(type), i);
-    }
-    else {
-        fmt::print("Pushing numeric constant '{}' of type {} at {}\n", s, varTypeEnumToString(type), this->symbols.size());
-        this->symbols.push_back(Symbol(s, SymbolTypes::ST_NUM, type));
-        return this->symbols.size()-1;
+void SymbolTable::enterScope()
+{
+    this->scopeMarks.push_back(this->scopeBindings.size());
+    TRACE(TC_SYMTAB, TL_INFO, "Entered scope {}\n", this->getScopeDepth());
+}
+// Unbinds everything the innermost scope declared, restoring the bindings
+// it shadowed. Costs only the number of symbols bound in that scope.
+void SymbolTable::leaveScope()
+{
+    if(this->scopeMarks.empty()) throw std::runtime_error("Cannot leave the global scope.");
+    size_t mark = this->scopeMarks.back();
+    while(this->scopeBindings.size() > mark)
+    {
+        size_t index = this->scopeBindings.back();
+        this->scopeBindings.pop_back();
+        this->atomSymbols[this->symbolNames[index]] = this->symbolShadowed[index];
     }
+    this->scopeMarks.pop_back();
+    TRACE(TC_SYMTAB, TL_INFO, "Left scope {}\n", this->getScopeDepth()+1);
 }
-size_t SymbolTable::getNextGlobalTemporaryAndIncrement()
+size_t SymbolTable::getScopeDepth()
 {
-    return this->nextGlobalTemporaryIndex++;
+    return this->scopeMarks.size();
 }
-size_t SymbolTable::getNextLabelIndex()
+// The scanner resolves identifiers before the parser knows they are being
+// declared, so a declaration of a name bound in an outer scope gets a new
+// symbol here that shadows the outer one.
+size_t SymbolTable::declareInCurrentScope(size_t index)
 {
-    return this->nextLabel++;
+    if(SymbolTable::isTemporary(index) || this->at(index)->getSymbolType() != SymbolTypes::ST_ID) {
+        throw std::runtime_error(fmt::format("{} cannot be declared.", this->getAttribute(index)));
+    }
+    if(this->symbolScopes[index] == this->getScopeDepth()) return index;
+    size_t shadowing = this->pushSymbol(Symbol(SymbolTypes::ST_ID), this->symbolNames[index]);
+    TRACE(TC_SYMTAB, TL_INFO, "'{}'({}) shadows {} in scope {}\n", this->getAttribute(index), shadowing, index, this->getScopeDepth());
+    return shadowing;
 }
-
-size_t SymbolTable::pushNextLabelIndex()
+address_t SymbolTable::getTemporarySlot(VarTypes type)
 {
-    size_t index = this->nextLabel++;
-    this->labelStack.push(index);
+    std::vector<address_t>& freeSlots = varTypeToSize(type) == 8 ? this->freeSlots8 : this->freeSlots4;
+    if(freeSlots.empty()) {
+        return this->getGlobalAddressAndIncrement(type);
+    }
+    address_t addr = freeSlots.back();
+    freeSlots.pop_back();
+    return addr;
+}
+size_t SymbolTable::getNewTemporaryVariable(VarTypes type)
+{
+    address_t addr = this->getTemporarySlot(type);
+    size_t id = this->temporaries.emplace_back(SymbolTypes::ST_ID, type, addr);
+    this->temporaryDescriptors.emplace_back();
+    size_t index = id | TEMPORARY_BIT;
+    this->at(index)->markTemporary(varTypeToSize(type) == 8);
+    this->statementTemporaries.push_back(index);
+    TRACE(TC_SYMTAB, TL_DEBUG, "Created new temporary $t{} of type {} @{}\n", id, varTypeEnumToString(type), addr);
     return index;
 }
-size_t SymbolTable::popLabelIndex()
-{   
-    size_t index = this->labelStack.top();
-    this->labelStack.pop();
+// An array element whose address is known at compile time. It lives in the
+// temporaries' index space for its descriptor, but owns no slot and is
+// never released.
+size_t SymbolTable::getArrayElement(size_t arrayIndex, size_t indexSymbol, address_t address)
+{
+    size_t id = this->temporaries.emplace_back(SymbolTypes::ST_ID, this->at(arrayIndex)->getVarType(), address);
+    this->temporaryDescriptors.emplace_back();
+    size_t index = id | TEMPORARY_BIT;
+    this->setDescriptor(index, DescriptorKinds::DK_INDEX, arrayIndex, indexSymbol);
     return index;
 }
-size_t SymbolTable::getNewTemporaryVariable(VarTypes type, std::string descriptor)
+// Returns the temporary's slot to the free list once its value has been
+// consumed. Does nothing for variables, constants and released temporaries.
+void SymbolTable::releaseTemporary(size_t index)
+{
+    if(this->recycleWithinStatements) this->freeTemporarySlot(index);
+}
+void SymbolTable::freeTemporarySlot(size_t index)
+{
+    Symbol* s = this->at(index);
+    if(!s->isLiveTemporary()) return;
+    s->markReleased();
+    // the slot size is fixed at allocation, array element references change their type later
+    if(s->hasWideSlot()) {
+        this->freeSlots8.push_back(s->getAddress());
+    }
+    else {
+        this->freeSlots4.push_back(s->getAddress());
+    }
+}
+// Releases whatever the finished statement left live.
+void SymbolTable::releaseStatementTemporaries()
+{
+    for(size_t index : this->statementTemporaries)
+    {
+        this->freeTemporarySlot(index);
+    }
+    this->statementTemporaries.clear();
+}
+void SymbolTable::holdTemporary(size_t index)
+{
+    auto held = std::find(this->statementTemporaries.begin(), this->statementTemporaries.end(), index);
+    if(held != this->statementTemporaries.end()) this->statementTemporaries.erase(held);
+}
+// Hands a held temporary back to the statement that computed it.
+void SymbolTable::releaseHeldTemporary(size_t index)
+{
+    if(!SymbolTable::isTemporary(index) || !this->at(index)->isLiveTemporary()) return;
+    this->statementTemporaries.push_back(index);
+    this->releaseTemporary(index);
+}
+void SymbolTable::setRecycleWithinStatements(bool recycle)
+{
+    this->recycleWithinStatements = recycle;
+}
+address_t SymbolTable::getDataSize()
 {
-    std::string name = fmt::format("$t{}", this->getNextGlobalTemporaryAndIncrement());
-    address_t addr = this->getGlobalAddressAndIncrement(type);
-    this->symbols.push_back(Symbol(name, SymbolTypes::ST_ID, type, addr));
-    Symbol *ts = this->at(this->symbols.size()-1);
-    ts->setDescriptor(descriptor);
-    fmt::print("Created new temporary {}({}) of type {} at {} @{}\n", name, ts->getDescriptor(), varTypeEnumToString(type), this->symbols.size()-1, addr);
-    return this->symbols.size()-1;
+    return this->lastGlobalAddress;
 }
 Symbol* SymbolTable::at(size_t index)
 {
+    if(SymbolTable::isTemporary(index)) {
+        return &this->temporaries.at(index & ~TEMPORARY_BIT);
+    }
     return &this->symbols.at(index);
 }
+bool SymbolTable::isTemporary(size_t index)
+{
+    return index & TEMPORARY_BIT;
+}
+std::string_view SymbolTable::getAttribute(size_t index)
+{
+    if(SymbolTable::isTemporary(index)) {
+        return "$t";
+    }
+    if(this->at(index)->getSymbolType() == SymbolTypes::ST_NUM) {
+        return this->constants.getSpelling(this->symbolNames[index]);
+    }
+    return this->atoms.view(this->symbolNames[index]);
+}
+std::string SymbolTable::getDescriptor(size_t index)
+{
+    fmt::memory_buffer out;
+    this->appendDescriptor(out, index);
+    return fmt::to_string(out);
+}
+void SymbolTable::appendDescriptor(fmt::memory_buffer& out, size_t index)
+{
+    if(!SymbolTable::isTemporary(index)) {
+        std::string_view attribute = this->getAttribute(index);
+        out.append(attribute.data(), attribute.data()+attribute.size());
+        return;
+    }
+    const Descriptor& d = this->temporaryDescriptors.at(index & ~TEMPORARY_BIT);
+    switch(d.kind)
+    {
+        case DescriptorKinds::DK_BINARY:
+            this->appendDescriptor(out, d.lhs);
+            out.append(fmt::string_view(d.op));
+            this->appendDescriptor(out, d.rhs);
+        break;
+        case DescriptorKinds::DK_TOREAL:
+            out.append(fmt::string_view("real("));
+            this->appendDescriptor(out, d.lhs);
+            out.push_back(')');
+        break;
+        case DescriptorKinds::DK_TOINT:
+            out.append(fmt::string_view("int("));
+            this->appendDescriptor(out, d.lhs);
+            out.push_back(')');
+        break;
+        case DescriptorKinds::DK_NOT:
+            out.push_back('!');
+            this->appendDescriptor(out, d.lhs);
+        break;
+        case DescriptorKinds::DK_INDEX:
+            this->appendDescriptor(out, d.lhs);
+            out.push_back('[');
+            this->appendDescriptor(out, d.rhs);
+            out.push_back(']');
+        break;
+        default:
+            fmt::format_to(std::back_inserter(out), "$t{}", index & ~TEMPORARY_BIT);
+        break;
+    }
+}
+void SymbolTable::setDescriptor(size_t index, DescriptorKinds kind, size_t lhs, size_t rhs, const char* op)
+{
+    if(!SymbolTable::isTemporary(index)) {
+        throw std::runtime_error(fmt::format("Only temporaries have descriptors, {} does not.", this->getAttribute(index)));
+    }
+    Descriptor& d = this->temporaryDescriptors.at(index & ~TEMPORARY_BIT);
+    d.kind = kind;
+    d.lhs = (uint32_t)lhs;
+    d.rhs = (uint32_t)rhs;
+    d.op = op;
+}
+std::tuple<size_t, size_t> SymbolTable::getArrayBounds(size_t index)
+{
+    auto it = this->symbolArrayBounds.find(index);
+    if(it == this->symbolArrayBounds.end()) return std::tuple<size_t, size_t>{0,0};
+    return it->second;
+}
+void SymbolTable::setArrayBounds(size_t index, std::tuple<size_t, size_t> bounds)
+{
+    this->symbolArrayBounds[index] = bounds;
+    this->at(index)->setIsArray(true);
+}
 void SymbolTable::addToIdentifierListStack(size_t ind)
 {
-    fmt::print("Added '{}'({}) to id list.\n", this->at(ind)->getAttribute(), ind);
+    ind = this->declareInCurrentScope(ind);
+    TRACE(TC_SYMTAB, TL_DEBUG, "Added '{}'({}) to id list.\n", this->getAttribute(ind), ind);
     this->identifierListStack.push_back(ind);
 }
 void SymbolTable::clearIdentifierList()
 {
-    fmt::print("Cleared id list.\n");
+    TRACE(TC_SYMTAB, TL_DEBUG, "Cleared id list.\n");
     this->identifierListStack.clear();
 }
 
@@ -247,24 +487,24 @@ void SymbolTable::setMemoryIdentifierList(VarTypes type, bool empty)
     size_t aStart = std::get<0>(this->arrayBounds);
     size_t aEnd = std::get<1>(this->arrayBounds);
     if(this->isTypeArray()) {
-        fmt::print(
+        TRACE(TC_SYMTAB, TL_DEBUG,
             "Pushing id list to memory with type {}[{}..{}]:\n", 
             varTypeEnumToString( type ), aStart, aEnd);
     }
     else {
-        fmt::print("Pushing id list to memory with type {}:\n", varTypeEnumToString( type ));
+        TRACE(TC_SYMTAB, TL_DEBUG, "Pushing id list to memory with type {}:\n", varTypeEnumToString( type ));
     }
     for(auto i:this->identifierListStack)
     {
         if(this->isTypeArray()) {
             address_t addr = this->getGlobalAddressAndIncrement(type, aEnd-aStart+1); // maybe remove +1???
-            fmt::print("\t'{}'({}) @{}\n", this->at(i)->getAttribute(), i, addr);
+            TRACE(TC_SYMTAB, TL_DEBUG, "\t'{}'({}) @{}\n", this->getAttribute(i), i, addr);
             this->at(i)->placeInMemory(type, addr);
-            this->at(i)->setArrayBounds({aStart,aEnd});
+            this->setArrayBounds(i, {aStart,aEnd});
         }
         else {
             address_t addr = this->getGlobalAddressAndIncrement(type); 
-            fmt::print("\t'{}'({}) @{}\n", this->at(i)->getAttribute(), i, addr);
+            TRACE(TC_SYMTAB, TL_DEBUG, "\t'{}'({}) @{}\n", this->getAttribute(i), i, addr);
             this->at(i)->placeInMemory(type, addr);
         }
         
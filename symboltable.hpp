@@ -1,82 +1,153 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <tuple>
-#include <climits>
-#include <stack>
-#define address_t long
-const address_t NO_ADDRESS = LONG_MAX;
-enum VarTypes {
-    VT_NOTYPE = 0,
-    VT_INT = 1,
-    VT_REAL = 2
-};
-std::string varTypeEnumToString(VarTypes t);
-enum SymbolTypes {
-    ST_NUM = 0,
-    ST_ID = 1
-};
-int varTypeToSize(VarTypes t, size_t arraySize=0);
+#include <unordered_map>
+#include <cstdint>
+#include <fmt/format.h>
+#include "vartypes.hpp"
+#include "label.hpp"
+#include "interner.hpp"
+#include "constantpool.hpp"
+#include "arena.hpp"
+// Hot part of a symbol record, the fields code generation reads for every
+// operand. Names, descriptors and array bounds are kept in cold side
+// tables of SymbolTable, indexed by the same symbol index.
 class Symbol {
 private:
-    std::string attribute;
-    std::string descriptor;
-    SymbolTypes symbolType;
-    VarTypes varType = VarTypes::VT_NOTYPE;
-    std::tuple<size_t,size_t> arrayBounds = {0,0};
+    enum Flags : uint8_t {
+        SF_REFERENCE = 1,
+        SF_ARRAY = 2,
+        SF_TEMPORARY = 4,
+        SF_RELEASED = 8,
+        SF_WIDE_SLOT = 16 // temporary occupies an 8-byte slot
+    };
     address_t address = NO_ADDRESS;
-    bool isReference = false;
+    uint8_t varType = VarTypes::VT_NOTYPE;
+    uint8_t symbolType;
+    uint8_t flags = 0;
 public:
-    Symbol(std::string attr, SymbolTypes type);
-    Symbol(std::string attr, SymbolTypes type, VarTypes vtype);
-    Symbol(std::string attr, SymbolTypes stype, VarTypes vtype, address_t address);
-    ~Symbol();
-    const std::string getAttribute();
+    Symbol(SymbolTypes type);
+    Symbol(SymbolTypes stype, VarTypes vtype);
+    Symbol(SymbolTypes stype, VarTypes vtype, address_t address);
     address_t getAddress();
     SymbolTypes getSymbolType();
     VarTypes getVarType();
     void setVarType(VarTypes vt);
     void placeInMemory(VarTypes type, address_t address);
     bool isInMemory();
-    std::string getDescriptor();
-    void setDescriptor(std::string desc);
     bool isArray();
-    std::tuple<size_t, size_t> getArrayBounds();
-    void setArrayBounds(std::tuple<size_t, size_t> bounds);
+    void setIsArray(bool array);
     void setIsReference(bool ref);
     bool getIsReference();
+    void markTemporary(bool wideSlot);
+    bool isLiveTemporary();
+    // true for temporaries, live or released, but not for array elements
+    bool isTemporary();
+    bool hasWideSlot();
+    void markReleased();
+};
+static_assert(sizeof(Symbol) == 16, "Symbol hot record should stay 16 bytes");
+
+enum DescriptorKinds : uint8_t {
+    DK_NAME = 0,    // the symbol's own name
+    DK_BINARY = 1,  // lhs op rhs
+    DK_TOREAL = 2,  // real(lhs)
+    DK_TOINT = 3,   // int(lhs)
+    DK_NOT = 4,     // !lhs
+    DK_INDEX = 5    // lhs[rhs]
+};
+// Temporaries live in their own index space, apart from named symbols.
+// Their indices carry this bit so the parser can keep passing plain
+// indices around.
+const size_t TEMPORARY_BIT = (size_t)1 << 31;
+
+// Source-level description of a temporary, kept as a node over operand
+// symbol indices and only rendered to text when a comment asks for it.
+// Named symbols and constants are described by their own spelling.
+struct Descriptor {
+    const char* op = nullptr;
+    uint32_t lhs = 0;
+    uint32_t rhs = 0;
+    DescriptorKinds kind = DescriptorKinds::DK_NAME;
 };
 
 
 class SymbolTable {
 private:
     address_t lastGlobalAddress = 0;
-    size_t nextGlobalTemporaryIndex = 0;
-    size_t nextLabel = 0;
-    std::vector<Symbol> symbols;
+    uint32_t nextLabel = 0;
+    ChunkedArena<Symbol> symbols;
+    ChunkedArena<Symbol> temporaries;
+    ChunkedArena<Descriptor> temporaryDescriptors;
+    // cold side tables
+    std::vector<uint32_t> symbolNames; // atom for ST_ID, constant for ST_NUM
+    std::unordered_map<size_t, std::tuple<size_t, size_t>> symbolArrayBounds;
+    StringInterner atoms;
+    ConstantPool constants;
+    std::vector<size_t> atomSymbols; // atom -> innermost symbol bound to it
+    std::vector<size_t> symbolShadowed; // binding of the same name this symbol hides
+    std::vector<uint32_t> symbolScopes; // scope depth the symbol was bound at
+    std::vector<size_t> scopeBindings; // symbols bound in open scopes, innermost last
+    std::vector<size_t> scopeMarks; // scopeBindings size at each scope entry
+    size_t pushSymbol(Symbol s, uint32_t name);
     static SymbolTable* instance;
     address_t getGlobalAddressAndIncrement(VarTypes type, size_t arraySize=0);
-    size_t getNextGlobalTemporaryAndIncrement();
     std::vector<size_t> identifierListStack;
     std::tuple<size_t, size_t> arrayBounds = {0,0};
-    std::stack<size_t> labelStack;
+    // recycled temporary slots, by size
+    std::vector<address_t> freeSlots4;
+    std::vector<address_t> freeSlots8;
+    std::vector<size_t> statementTemporaries;
+    bool recycleWithinStatements = true;
+    address_t getTemporarySlot(VarTypes type);
+    void freeTemporarySlot(size_t index);
 public:
     SymbolTable();
     ~SymbolTable();
     void setDefault();
     static SymbolTable* getDefault();
-    bool tryGetSymbolIndex(std::string s, size_t& index);
-    size_t getSymbolIndex(std::string s);
-    size_t insertOrGetSymbolIndex(std::string s);
-    size_t insertOrGetNumericalConstant(std::string s);
-    size_t getNewTemporaryVariable(VarTypes type, std::string descriptor="");
+    void reserveForInputSize(size_t bytes);
+    bool tryGetSymbolIndex(atom_t atom, size_t& index);
+    bool tryGetSymbolIndex(std::string_view s, size_t& index);
+    size_t getSymbolIndex(std::string_view s);
+    size_t insertOrGetSymbolIndex(const char* text, size_t length);
+    size_t insertOrGetSymbolIndex(std::string_view s);
+    size_t insertOrGetIntegerConstant(const char* text, size_t length);
+    size_t insertOrGetRealConstant(const char* text, size_t length);
+    size_t insertOrGetIntegerConstant(int64_t value);
+    size_t insertOrGetRealConstant(double value);
+    int64_t getIntegerConstant(size_t index);
+    double getRealConstant(size_t index);
+    void enterScope();
+    void leaveScope();
+    size_t getScopeDepth();
+    size_t declareInCurrentScope(size_t index);
+    size_t getNewTemporaryVariable(VarTypes type);
+    size_t getArrayElement(size_t arrayIndex, size_t indexSymbol, address_t address);
+    void releaseTemporary(size_t index);
+    void releaseStatementTemporaries();
+    // Keeps a temporary that is read again on every pass of a loop out of
+    // the statements nested in it, until releaseHeldTemporary.
+    void holdTemporary(size_t index);
+    void releaseHeldTemporary(size_t index);
+    // When off, released temporaries keep their slots until the end of the
+    // statement, so every value computed in it stays where it was put.
+    void setRecycleWithinStatements(bool recycle);
+    address_t getDataSize();
     Symbol* at(size_t index);
+    static bool isTemporary(size_t index);
+    std::string_view getAttribute(size_t index);
+    std::string getDescriptor(size_t index);
+    void appendDescriptor(fmt::memory_buffer& out, size_t index);
+    void setDescriptor(size_t index, DescriptorKinds kind, size_t lhs, size_t rhs=0, const char* op=nullptr);
+    std::tuple<size_t, size_t> getArrayBounds(size_t index);
+    void setArrayBounds(size_t index, std::tuple<size_t, size_t> bounds);
     void addToIdentifierListStack(size_t index);
     void setMemoryIdentifierList(VarTypes type, bool empty=true);
     void clearIdentifierList();
-    size_t getNextLabelIndex();
-    size_t pushNextLabelIndex();
-    size_t popLabelIndex();
+    Label getNextLabelIndex(LabelKinds kind=LabelKinds::LK_PLAIN);
     void setCurrentArraySize(std::tuple<size_t, size_t> bounds);
     std::tuple<size_t, size_t> getCurrentArraySize();
     bool isTypeArray();
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Compile time vs program size. Generates programs with N assignment
+# statements over N/10 variables and times ./comp on each of them.
+# usage: tests/bench.sh [comp] [sizes...]
+COMP=$(realpath ${1:-./comp})
+shift
+SIZES=${@:-"1000 2000 4000 8000 16000 32000"}
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+cd $WORKDIR
+
+generate() {
+    awk -v n=$1 'BEGIN {
+        vars = int(n/10)+1
+        print "program bench(input, output);"
+        for(i = 0; i < vars; i++) print "var v" i ": integer;"
+        print "begin"
+        for(i = 0; i < n; i++) {
+            sep = (i == n-1) ? "" : ";"
+            print "\tv" (i%vars) ":=v" ((i*7)%vars) "+" i "*v" ((i*13)%vars) sep
+        }
+        print "end."
+    }'
+}
+
+printf "%10s %12s %14s\n" statements seconds us/statement
+for n in $SIZES; do
+    generate $n > bench.pas
+    start=$(date +%s.%N)
+    $COMP < bench.pas > /dev/null
+    end=$(date +%s.%N)
+    awk -v n=$n -v s=$start -v e=$end 'BEGIN { t = e-s; printf "%10d %12.3f %14.2f\n", n, t, t*1e6/n }'
+done
@@ -0,0 +1,37 @@
+#!/bin/bash
+# Synchronous vs asynchronous output writing. Compiles one generated
+# program of N statements into DIR, which should be on the filesystem
+# under test (a network mount, a slow disk), with and without
+# --async-output. DIR defaults to a temporary directory.
+# usage: tests/bench_async.sh [comp] [dir] [statements] [runs]
+COMP=$(realpath ${1:-./comp})
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+DIR=$(realpath ${2:-$WORKDIR})
+N=${3:-200000}
+RUNS=${4:-3}
+
+awk -v n=$N 'BEGIN {
+    vars = int(n/10)+1
+    print "program bench(input, output);"
+    for(i = 0; i < vars; i++) print "var v" i ": integer;"
+    print "begin"
+    for(i = 0; i < n; i++) {
+        sep = (i == n-1) ? "" : ";"
+        print "\tv" (i%vars) ":=v" ((i*7)%vars) "+" i "*v" ((i*13)%vars) "-v" ((i*3)%vars) sep
+    }
+    print "end."
+}' > $WORKDIR/bench.pas
+
+cd $DIR
+printf "%8s %12s\n" mode seconds
+for run in $(seq $RUNS); do
+    for mode in sync async; do
+        flag=""
+        [ $mode = async ] && flag=--async-output
+        start=$(date +%s.%N)
+        $COMP $flag < $WORKDIR/bench.pas > /dev/null
+        end=$(date +%s.%N)
+        awk -v m=$mode -v s=$start -v e=$end 'BEGIN { printf "%8s %12.3f\n", m, e-s }'
+    done
+done
@@ -0,0 +1,50 @@
+// Emitter throughput: emits a fixed instruction mix into /dev/null (or the
+// file given as the second argument) and reports instructions per second.
+// usage: tests/bench_emitter [instructions] [output] [asm|bytecode] [sync|async]
+#include "../emitter.hpp"
+#include <fmt/format.h>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+    const char* path = argc > 2 ? argv[2] : "/dev/null";
+    bool bytecode = argc > 3 && std::string(argv[3]) == "bytecode";
+    bool async = argc > 4 && std::string(argv[4]) == "async";
+    SymbolTable st;
+    st.setDefault();
+    Emitter e(path);
+    e.setDefault();
+    e.setFormat(bytecode ? EmitFormats::EF_BYTECODE : EmitFormats::EF_ASM);
+    if(async) e.enableAsyncOutput();
+    size_t x = st.insertOrGetSymbolIndex("x");
+    st.addToIdentifierListStack(x);
+    st.setMemoryIdentifierList(VarTypes::VT_INT);
+    size_t y = st.insertOrGetSymbolIndex("y");
+    st.addToIdentifierListStack(y);
+    st.setMemoryIdentifierList(VarTypes::VT_REAL);
+    size_t one = st.insertOrGetIntegerConstant(1);
+    size_t half = st.insertOrGetRealConstant(0.5);
+    size_t ti = st.getNewTemporaryVariable(VarTypes::VT_INT);
+    size_t tr = st.getNewTemporaryVariable(VarTypes::VT_REAL);
+
+    auto start = std::chrono::steady_clock::now();
+    e.beginProgram();
+    size_t emitted = 0;
+    while(emitted < count) {
+        e.generateCode(Opcodes::OP_ADD, "x+1", x, one, ti);
+        e.generateCode(Opcodes::OP_INTTOREAL, "real(x+1)", ti, tr);
+        e.generateCode(Opcodes::OP_MUL, "real(x+1)*0.5", tr, half, tr);
+        e.generateCode(Opcodes::OP_MOV, "y:=real(x+1)*0.5", tr, y);
+        e.generateCode(Opcodes::OP_JE, "", x, one, Label{1, LabelKinds::LK_PLAIN});
+        e.endStatement();
+        emitted += 5;
+    }
+    e.endProgram();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    fmt::print(stderr, "{:>12} instructions {:>10.3f} s {:>14.0f} instructions/s\n",
+        emitted, elapsed.count(), emitted / elapsed.count());
+    return 0;
+}
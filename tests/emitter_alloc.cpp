@@ -0,0 +1,65 @@
+// Counts heap allocations made by the Emitter. Once its buffers are warm,
+// recording an instruction and lowering the IR must not allocate.
+#include "../emitter.hpp"
+#include <fmt/format.h>
+#include <cstdlib>
+#include <new>
+
+static size_t allocations = 0;
+void* operator new(size_t size)
+{
+    allocations++;
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+int main()
+{
+    SymbolTable st;
+    st.setDefault();
+    Emitter e("/dev/null");
+    e.setDefault();
+    size_t x = st.insertOrGetSymbolIndex("x");
+    st.addToIdentifierListStack(x);
+    st.setMemoryIdentifierList(VarTypes::VT_INT);
+    size_t y = st.insertOrGetSymbolIndex("y");
+    st.addToIdentifierListStack(y);
+    st.setMemoryIdentifierList(VarTypes::VT_REAL);
+    size_t one = st.insertOrGetIntegerConstant(1);
+    size_t half = st.insertOrGetRealConstant(0.5);
+    size_t ti = st.getNewTemporaryVariable(VarTypes::VT_INT);
+    size_t tr = st.getNewTemporaryVariable(VarTypes::VT_REAL);
+    st.at(ti)->setIsReference(true);
+
+    auto emitAll = [&]() {
+        e.generateCode(Opcodes::OP_ADD, "x+1", x, one, ti);
+        e.generateCode(Opcodes::OP_INTTOREAL, "real(x+1)", ti, tr);
+        e.generateCode(Opcodes::OP_MUL, "real(x+1)*0.5", tr, half, tr);
+        e.generateCode(Opcodes::OP_WRITE, "write(y)", y);
+        e.generateCode(Opcodes::OP_SUB, "x-1", x, Immediate{1}, ti);
+        e.generateCode(Opcodes::OP_JE, "", x, one, Label{1, LabelKinds::LK_TRUE});
+        e.generateCode(Opcodes::OP_MOV, "", Immediate{0}, x);
+        e.generateCode(Opcodes::OP_JE, "", x, Immediate{0}, Label{2, LabelKinds::LK_ELSE});
+        e.subFromZero(x, ti);
+        e.generateLabel(Label{1, LabelKinds::LK_TRUE});
+        e.generateJump(Label{2, LabelKinds::LK_ELSE});
+        e.generateLabel(Label{2, LabelKinds::LK_ELSE});
+        e.endStatement();
+    };
+    // enough rounds for endStatement to lower the IR several times
+    const int rounds = 20000;
+    emitAll();
+    size_t before = allocations;
+    for(int i = 0; i < rounds; i++) emitAll();
+    size_t made = allocations - before;
+    fmt::print(stderr, "emitter_alloc: {} allocations for {} instructions\n", made, rounds*12);
+    return made == 0 ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+# Runs each program compiled at -O0, -O1 and -O2 and checks that all three
+# write the same values and fault alike. Where tests/unit/NAME.out exists,
+# the -O0 values must also match it.
+# usage: tests/outputs.sh [comp] [vm] [programs...]
+COMP=$(realpath ${1:-./comp})
+VM=$(realpath ${2:-./tests/vm})
+shift 2
+PROGRAMS=$(realpath ${@:-tests/unit/*.pas p*.pas})
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+cd $WORKDIR
+
+# run LEVEL PROGRAM: leaves the written values in LEVEL.txt, the exit status in LEVEL.status
+run() {
+    rm -f myoutput.asm
+    $COMP $1 --no-comments < $2 > /dev/null
+    [ -s myoutput.asm ] || return 1
+    $VM myoutput.asm > $1.txt 2> /dev/null
+    echo $? > $1.status
+}
+
+status=0
+for f in $PROGRAMS; do
+    run -O0 $f || continue # does not compile
+    [ "$(cat -- -O0.status)" = 2 ] && continue # does not stop
+    expected=${f%.pas}.out
+    if [ -f $expected ] && ! cmp -s -- -O0.txt $expected; then
+        echo "outputs: $f at -O0 differs from $(basename $expected)"
+        status=1
+    fi
+    for level in -O1 -O2; do
+        run $level $f
+        if ! cmp -s -- -O0.txt $level.txt || ! cmp -s -- -O0.status $level.status; then
+            echo "outputs: $f at $level differs from -O0"
+            status=1
+        fi
+    done
+    printf "%-40s %8d values\n" $(basename $f) $(wc -l < -O0.txt)
+done
+exit $status
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Compiles each program to text and to bytecode and checks that the
+# disassembled bytecode matches the text output byte for byte.
+# usage: [OPTIONS=-O2] tests/roundtrip.sh [comp] [disasm] [programs...]
+COMP=$(realpath ${1:-./comp})
+DISASM=$(realpath ${2:-./disasm})
+shift 2
+PROGRAMS=$(realpath ${@:-tests/unit/*.pas p*.pas})
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+cd $WORKDIR
+
+status=0
+for f in $PROGRAMS; do
+    rm -f myoutput.asm myoutput.bc
+    $COMP $OPTIONS --no-comments < $f > /dev/null
+    [ -s myoutput.asm ] || continue # does not compile
+    $COMP $OPTIONS --emit=bytecode < $f > /dev/null
+    if ! $DISASM myoutput.bc | cmp -s - myoutput.asm; then
+        echo "roundtrip: $f differs"
+        status=1
+    fi
+    printf "%-40s %8d bytes asm %8d bytes bytecode\n" $(basename $f) $(stat -c %s myoutput.asm) $(stat -c %s myoutput.bc)
+done
+exit $status
@@ -0,0 +1,64 @@
+#!/bin/bash
+# Checks that the optimizations fire on the test programs written for
+# them, by counting matching instructions in the compiled output. What
+# the programs compute is checked by tests/outputs.sh.
+# usage: tests/shapes.sh [comp]
+COMP=$(realpath ${1:-./comp})
+UNIT=$(realpath $(dirname $0)/unit)
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+cd $WORKDIR
+
+status=0
+# count LEVEL PROGRAM PATTERN EXPECTED
+count() {
+    rm -f myoutput.asm
+    $COMP $1 --no-comments < $UNIT/$2.pas > /dev/null
+    local n=$(grep -cE -- "$3" myoutput.asm)
+    if [ "$n" != "$4" ]; then
+        echo "shapes: $2 at $1 has $n instructions matching '$3', expected $4"
+        status=1
+    fi
+}
+# hits PROGRAM RULE EXPECTED, for the peephole rules at -O1
+hits() {
+    local n=$($COMP -O1 --trace=opt --no-comments < $UNIT/$1.pas 2>&1 > /dev/null | grep -E "^peephole +[0-9]+ $2\$" | awk '{print $2}')
+    if [ "$n" != "$3" ]; then
+        echo "shapes: $1 hits peephole rule '$2' ${n:-no} times, expected $3"
+        status=1
+    fi
+}
+
+# every write of a constant expression writes its value, and only the
+# operations folding must decline are left with two constant operands
+count -O1 fold '^\swrite\.[ir] #' 17
+count -O1 fold '^\s(add|sub|mul|div|mod|and|or)\.[ir] #[^,]*, #' 3
+count -O1 fold '^\sdiv\.i #7, #0' 1
+count -O1 fold '^\sadd\.i #2147483647, #1' 1
+
+# a*b is computed again only once a changes and after the store through
+# ai[b-6], x+2 once per statement; a*b+a*b and a*b-a*b read one product
+count -O0 cse '^\smul\.i 120, 124,' 8
+count -O2 cse '^\smul\.i 120, 124,' 3
+count -O2 cse '^\sadd\.i 128, #2,' 3
+count -O2 cse '^\s(add|sub)\.i ([0-9]+), \2,' 2
+
+# b*c and s*r read the variables b and s were copied from, computations
+# go straight into the assigned variable, and the only mov left from a
+# temporary keeps a+7, which is read again past the labels of b>d
+count -O2 copy '^\smul\.i 12, 20,' 1
+count -O2 copy '^\smul\.r 32, 32,' 1
+count -O2 copy '^\sadd\.i 12, #1, 20' 1
+count -O2 copy '^\smov\.[ir] (4[89]|5[0-9]), ' 1
+count -O2 liveness '^\ssub\.i 32, 36, 8' 1
+
+# every peephole rule fires, and the negation of a constant that only
+# the VM's wrapping can compute is left to the VM
+hits peephole 'jump to the next label' 1
+hits peephole 'mov to itself' 1
+hits peephole 'mov back' 1
+hits peephole 'materialized boolean test' 5
+hits peephole 'conditional jump over a jump' 4
+hits peephole 'unused label' 4
+count -O1 peephole '^\ssub\.i #0, #2147483648,' 1
+exit $status
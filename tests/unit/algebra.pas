@@ -0,0 +1,47 @@
+program algebra(input, output);
+var ai: array[1..3] of integer;
+var a, b, x: integer;
+var r, s: real;
+
+procedure p(u:integer; v:integer);
+begin
+  b := b
+end;
+
+begin
+  a := 7;
+  b := -3;
+  ai[1] := 4;
+  p(a + 0, ai[a+b*2]);
+  p(a * 1, a div b);
+  r := 2.5;
+  s := 0.0 - 0.0;
+  write(a * 1);
+  write(1 * a);
+  write(a + 0);
+  write(0 + a);
+  write(a - 0);
+  write(a * 0);
+  write(a - a);
+  write(a div 1);
+  write(a mod 1);
+  write(b * 2);
+  write(r * 1.0);
+  write(r - 0.0);
+  write(r / 1.0);
+  write(r * 2.0);
+  write(s + 0.0);
+  write(s * 1.0);
+  write(a + 1 + 2);
+  write(a - 1 + 5);
+  write(a + 1 - 1);
+  write(1 + a + 2);
+  write(a * 2 * 3);
+  write(b - 4 - 6);
+  write((a + b) * 1 + 0);
+  write(r * 1 + a * 1);
+  if a + 0 > b * 1 then write(a) else write(b);
+  x := 5;
+  x := x - 2147483647 - 1;
+  write(x)
+end.
@@ -0,0 +1,33 @@
+program copy(input, output);
+var ai: array[1..3] of integer;
+var a, b, c, d, i: integer;
+var r, s: real;
+begin
+  a := 2;
+  b := a;
+  c := b + 1;
+  write(b * c);
+  b := 5;
+  write(b + c);
+  a := b;
+  b := a;
+  write(a + b);
+  i := 1;
+  ai[i] := a;
+  c := ai[i];
+  write(c + ai[i]);
+  r := a;
+  s := r;
+  write(s * r);
+  i := c;
+  c := i + 1;
+  i := i + c;
+  write(i);
+  c := c;
+  write(c);
+  a := 1;
+  d := 100;
+  b := a + 7;
+  c := (a + 7) - (b > d);
+  write(c)
+end.
@@ -0,0 +1,24 @@
+program cse(input, output);
+var ai: array[1..10] of integer;
+var ar: array[1..10] of real;
+var a, b, x: integer;
+var r, s: real;
+begin
+  a := 6;
+  b := 7;
+  x := 3;
+  ai[x+2] := 4;
+  ar[x+2] := 1.5;
+  write(ar[x+2] + ai[x+2]);
+  write((a*b) + (a*b));
+  r := a + 0.5;
+  s := a * r + a;
+  write(s);
+  x := a * b;
+  a := 1;
+  write(a * b + x);
+  write(a*b - a*b);
+  ai[a] := a*b;
+  ai[b-6] := 9;
+  write(ai[a] + a*b)
+end.
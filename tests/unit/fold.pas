@@ -0,0 +1,33 @@
+program fold(input, output);
+var a, b: integer;
+var x, y: real;
+begin
+  a := 7;
+  x := 2.5;
+  write(10 mod 3);
+  write(-7 mod 3);
+  write(-7 div 2);
+  write(7 mod (0 - 3));
+  write(-7 div (0 - 2));
+  write(1 - 2.5);
+  write(3 * 2.0);
+  write(2147483647 + 1);
+  write(-(3 + 4));
+  write(-(2.5 * 2));
+  write(not 0);
+  write(not 5);
+  write(1 and 0);
+  write(1 or 0);
+  write(2 and 1);
+  write(3 < 4);
+  write(3.5 >= 4);
+  write(2 = 2.0);
+  write(1.0 / 3 * 3);
+  write(a + (2 * 3) - x * (1 + 1));
+  if 1 < 2 then write(a) else write(b);
+  y := (1 + 2) * (3 + 4) / 2;
+  write(y);
+  b := 5 * 3 - 2;
+  write(b);
+  write(7 div 0 + a)
+end.
@@ -0,0 +1,20 @@
+program liveness(input, output);
+var a, b, c, d: integer;
+var r, s: real;
+begin
+  a := 1;
+  d := 100;
+  b := a + 7;
+  c := (a + 7) - (b > d);
+  write(c);
+  c := (a + 7) * (b < d) + (a + 7);
+  write(c);
+  b := a * 3;
+  c := (a * 3) + ((b = 3) and (d > b)) + (a * 3);
+  write(c);
+  r := a + 0.5;
+  s := (a + 0.5) * (r < 2.0);
+  write(s);
+  c := (a + 7) - (b > d) - ((a + 7) < d);
+  write(c)
+end.
@@ -0,0 +1,19 @@
+program peephole(input, output);
+var a, b, c: integer;
+var r: real;
+begin
+  a := 1; b := 2; r := 0.5;
+  if a < b then c := 1 else c := 2;
+  write(c);
+  if not (a = b) then c := 3 else c := 4;
+  write(c);
+  if r > 0.25 then c := 5 else c := 6;
+  write(c);
+  a := a;
+  b := a; a := b;
+  write(a); write(b);
+  c := not (a < b);
+  write(c);
+  c := -2147483648;
+  write(c)
+end.
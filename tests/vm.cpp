@@ -0,0 +1,279 @@
+// Runs a program in the textual form comp writes with --no-comments and
+// prints every value it writes, one per line. It stands in for the VM so
+// that tests can check that optimized code computes what -O0 does:
+// 32-bit wrapping integers, truncating div and mod, doubles, and a fault
+// on integer division by zero.
+// usage: vm [--steps=N] file.asm
+// Exits with 1 on a fault or a malformed program, 2 when the step limit
+// runs out, as it does for programs that never stop.
+#include <fmt/format.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+enum OperandKinds : uint8_t {
+    OK_ADDRESS,
+    OK_INDIRECT,
+    OK_IMMEDIATE,
+    OK_LABEL
+};
+struct Operand {
+    OperandKinds kind;
+    int64_t integer;
+    double real;
+    std::string label;
+};
+struct Instruction {
+    std::string op;
+    bool real;
+    std::vector<Operand> operands;
+    size_t line;
+};
+class StepLimit : public std::runtime_error {
+public:
+    StepLimit() : std::runtime_error("step limit reached") {}
+};
+
+class Machine {
+private:
+    std::vector<Instruction> code;
+    std::unordered_map<std::string, size_t> labels;
+    std::vector<uint8_t> memory;
+
+    Operand parseOperand(const std::string& text, size_t line)
+    {
+        Operand operand{OperandKinds::OK_ADDRESS, 0, 0.0, ""};
+        const char* s = text.c_str();
+        if(text.compare(0, 4, "#lab") == 0) {
+            operand.kind = OperandKinds::OK_LABEL;
+            operand.label = text.substr(1);
+            return operand;
+        }
+        if(*s == '#') {
+            operand.kind = OperandKinds::OK_IMMEDIATE;
+            s++;
+        }
+        else if(*s == '*') {
+            operand.kind = OperandKinds::OK_INDIRECT;
+            s++;
+        }
+        char* end;
+        operand.real = std::strtod(s, &end);
+        if(end == s || *end != '\0') throw std::runtime_error(fmt::format("line {}: bad operand {}", line, text));
+        operand.integer = std::strtoll(s, nullptr, 10);
+        return operand;
+    }
+    uint8_t* at(int64_t address, size_t size)
+    {
+        if(address < 0) throw std::runtime_error(fmt::format("bad address {}", address));
+        if((size_t)address + size > this->memory.size()) this->memory.resize((size_t)address + size, 0);
+        return &this->memory[(size_t)address];
+    }
+    int64_t address(const Operand& operand)
+    {
+        if(operand.kind == OperandKinds::OK_INDIRECT) return this->loadInteger(operand.integer);
+        return operand.integer;
+    }
+    int32_t loadInteger(int64_t address)
+    {
+        int32_t value;
+        std::memcpy(&value, this->at(address, sizeof(value)), sizeof(value));
+        return value;
+    }
+    int32_t readInteger(const Operand& operand)
+    {
+        if(operand.kind == OperandKinds::OK_IMMEDIATE) return (int32_t)operand.integer;
+        return this->loadInteger(this->address(operand));
+    }
+    double readReal(const Operand& operand)
+    {
+        if(operand.kind == OperandKinds::OK_IMMEDIATE) return operand.real;
+        double value;
+        std::memcpy(&value, this->at(this->address(operand), sizeof(value)), sizeof(value));
+        return value;
+    }
+    void writeInteger(const Operand& operand, int32_t value)
+    {
+        std::memcpy(this->at(this->address(operand), sizeof(value)), &value, sizeof(value));
+    }
+    void writeReal(const Operand& operand, double value)
+    {
+        std::memcpy(this->at(this->address(operand), sizeof(value)), &value, sizeof(value));
+    }
+    size_t target(const Operand& operand)
+    {
+        auto label = this->labels.find(operand.label);
+        if(label == this->labels.end()) throw std::runtime_error(fmt::format("undefined label {}", operand.label));
+        return label->second;
+    }
+    static bool compare(const std::string& op, double a, double b)
+    {
+        if(op == "je") return a == b;
+        if(op == "jne") return a != b;
+        if(op == "jg") return a > b;
+        if(op == "jge") return a >= b;
+        if(op == "jl") return a < b;
+        return a <= b;
+    }
+    static size_t arity(const std::string& op)
+    {
+        if(op == "exit") return 0;
+        if(op == "jump" || op == "write") return 1;
+        if(op == "mov" || op == "inttoreal" || op == "realtoint") return 2;
+        return 3;
+    }
+    static bool isConditionalJump(const std::string& op)
+    {
+        return op == "je" || op == "jne" || op == "jg" || op == "jge" || op == "jl" || op == "jle";
+    }
+    int32_t integerOperation(const Instruction& ins, int32_t a, int32_t b)
+    {
+        // wrap around as the VM's 32-bit registers do
+        uint32_t ua = (uint32_t)a, ub = (uint32_t)b;
+        if(ins.op == "add") return (int32_t)(ua + ub);
+        if(ins.op == "sub") return (int32_t)(ua - ub);
+        if(ins.op == "mul") return (int32_t)(ua * ub);
+        if(ins.op == "and") return a && b;
+        if(ins.op == "or") return a || b;
+        if(b == 0) throw std::runtime_error(fmt::format("line {}: division by zero", ins.line));
+        if(a == INT32_MIN && b == -1) return ins.op == "div" ? INT32_MIN : 0;
+        if(ins.op == "div") return a / b;
+        if(ins.op == "mod") return a % b;
+        throw std::runtime_error(fmt::format("line {}: unknown instruction {}", ins.line, ins.op));
+    }
+    double realOperation(const Instruction& ins, double a, double b)
+    {
+        if(ins.op == "add") return a + b;
+        if(ins.op == "sub") return a - b;
+        if(ins.op == "mul") return a * b;
+        if(ins.op == "div") return a / b;
+        throw std::runtime_error(fmt::format("line {}: unknown instruction {}.r", ins.line, ins.op));
+    }
+public:
+    void load(std::istream& input)
+    {
+        std::string text;
+        size_t line = 0;
+        while(std::getline(input, text))
+        {
+            line++;
+            size_t first = text.find_first_not_of(" \t");
+            if(first == std::string::npos) continue;
+            text = text.substr(first, text.find(';') - first);
+            if(text.empty()) continue;
+            if(text.back() == ':') {
+                this->labels[text.substr(0, text.size() - 1)] = this->code.size();
+                continue;
+            }
+            Instruction ins;
+            ins.line = line;
+            size_t space = text.find(' ');
+            std::string mnemonic = text.substr(0, space);
+            size_t dot = mnemonic.find('.');
+            ins.op = mnemonic.substr(0, dot);
+            ins.real = dot != std::string::npos && mnemonic.compare(dot + 1, std::string::npos, "r") == 0;
+            while(space != std::string::npos)
+            {
+                size_t start = text.find_first_not_of(' ', space);
+                size_t comma = text.find(',', start);
+                std::string operand = text.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+                operand.erase(operand.find_last_not_of(' ') + 1);
+                ins.operands.push_back(this->parseOperand(operand, line));
+                space = comma == std::string::npos ? comma : comma + 1;
+            }
+            if(ins.operands.size() != arity(ins.op)) throw std::runtime_error(fmt::format("line {}: wrong operand count", line));
+            this->code.push_back(ins);
+        }
+    }
+    void run(uint64_t steps)
+    {
+        size_t pc = 0;
+        while(pc < this->code.size())
+        {
+            if(steps-- == 0) throw StepLimit();
+            const Instruction& ins = this->code[pc++];
+            const std::vector<Operand>& o = ins.operands;
+            if(ins.op == "exit") {
+                return;
+            }
+            else if(ins.op == "jump") {
+                pc = this->target(o[0]);
+            }
+            else if(isConditionalJump(ins.op)) {
+                bool taken = ins.real ? compare(ins.op, this->readReal(o[0]), this->readReal(o[1]))
+                    : compare(ins.op, this->readInteger(o[0]), this->readInteger(o[1]));
+                if(taken) pc = this->target(o[2]);
+            }
+            else if(ins.op == "write") {
+                if(ins.real) {
+                    fmt::print("{}\n", this->readReal(o[0]));
+                }
+                else {
+                    fmt::print("{}\n", this->readInteger(o[0]));
+                }
+            }
+            else if(ins.op == "mov") {
+                if(ins.real) {
+                    this->writeReal(o[1], this->readReal(o[0]));
+                }
+                else {
+                    this->writeInteger(o[1], this->readInteger(o[0]));
+                }
+            }
+            else if(ins.op == "inttoreal") {
+                this->writeReal(o[1], (double)this->readInteger(o[0]));
+            }
+            else if(ins.op == "realtoint") {
+                this->writeInteger(o[1], (int32_t)std::lround(this->readReal(o[0])));
+            }
+            else if(ins.real) {
+                this->writeReal(o[2], this->realOperation(ins, this->readReal(o[0]), this->readReal(o[1])));
+            }
+            else {
+                this->writeInteger(o[2], this->integerOperation(ins, this->readInteger(o[0]), this->readInteger(o[1])));
+            }
+        }
+    }
+};
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t steps = 1000000;
+    int arg = 1;
+    if(arg < argc && std::strncmp(argv[arg], "--steps=", 8) == 0) {
+        steps = std::strtoull(argv[arg] + 8, nullptr, 10);
+        arg++;
+    }
+    if(arg + 1 != argc) {
+        fmt::print(stderr, "usage: {} [--steps=N] file.asm\n", argv[0]);
+        return 1;
+    }
+    std::ifstream input(argv[arg]);
+    if(!input) {
+        fmt::print(stderr, "cannot open {}\n", argv[arg]);
+        return 1;
+    }
+    Machine machine;
+    try {
+        machine.load(input);
+        machine.run(steps);
+    } catch (const StepLimit& e) {
+        std::fflush(stdout);
+        fmt::print(stderr, "{}: {}\n", argv[arg], e.what());
+        return 2;
+    } catch (const std::runtime_error& e) {
+        std::fflush(stdout);
+        fmt::print(stderr, "{}: {}\n", argv[arg], e.what());
+        return 1;
+    }
+    return 0;
+}
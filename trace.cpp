@@ -0,0 +1,42 @@
+#include "trace.hpp"
+
+uint8_t Trace::levels[TC_COUNT] = {};
+
+void Trace::setLevel(TraceCategory category, TraceLevel level)
+{
+    Trace::levels[category] = level;
+}
+void Trace::setAllLevels(TraceLevel level)
+{
+    for(size_t i = 0; i < TC_COUNT; i++) Trace::levels[i] = level;
+}
+bool Trace::configure(std::string_view spec)
+{
+    static const std::string_view categoryNames[TC_COUNT] = {"lexer", "symtab", "emit", "parser", "opt"};
+    while(!spec.empty())
+    {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma+1);
+        TraceLevel level = TraceLevel::TL_INFO;
+        size_t colon = item.find(':');
+        if(colon != std::string_view::npos)
+        {
+            std::string_view levelName = item.substr(colon+1);
+            if(levelName == "info") level = TraceLevel::TL_INFO;
+            else if(levelName == "debug") level = TraceLevel::TL_DEBUG;
+            else if(levelName == "off") level = TraceLevel::TL_OFF;
+            else return false;
+            item = item.substr(0, colon);
+        }
+        if(item == "all") {
+            Trace::setAllLevels(level);
+            continue;
+        }
+        size_t category = 0;
+        while(category < TC_COUNT && categoryNames[category] != item) category++;
+        if(category == TC_COUNT) return false;
+        Trace::setLevel((TraceCategory)category, level);
+    }
+    return true;
+}
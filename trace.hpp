@@ -0,0 +1,46 @@
+#pragma once
+#include <string_view>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/format.h>
+// Leveled diagnostics per compiler stage. TRACE statements above
+// TRACE_MAX_LEVEL are discarded at compile time together with their
+// arguments, build with -DTRACE_MAX_LEVEL=0 to drop all of them. The rest
+// cost one byte comparison unless their category is switched on at runtime.
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL 2
+#endif
+enum TraceCategory : uint8_t {
+    TC_LEXER = 0,
+    TC_SYMTAB,
+    TC_EMIT,
+    TC_PARSER,
+    TC_OPT,
+    TC_COUNT
+};
+enum TraceLevel : uint8_t {
+    TL_OFF = 0,
+    TL_INFO = 1,
+    TL_DEBUG = 2
+};
+class Trace {
+private:
+    static uint8_t levels[TC_COUNT];
+public:
+    static bool enabled(TraceCategory category, TraceLevel level)
+    {
+        return levels[category] >= level;
+    }
+    static void setLevel(TraceCategory category, TraceLevel level);
+    static void setAllLevels(TraceLevel level);
+    // Parses "category[:level][,category[:level]...]", where category is one
+    // of lexer, symtab, emit, parser, opt or all and level is info
+    // (the default), debug or off. Returns false on an unknown name.
+    static bool configure(std::string_view spec);
+};
+#define TRACE(category, level, ...) \
+    do { \
+        if constexpr((level) <= TRACE_MAX_LEVEL) { \
+            if(Trace::enabled((category), (level))) fmt::print(stderr, __VA_ARGS__); \
+        } \
+    } while(0)
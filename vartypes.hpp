@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <climits>
+#include <cstddef>
+#define address_t long
+const address_t NO_ADDRESS = LONG_MAX;
+enum VarTypes {
+    VT_NOTYPE = 0,
+    VT_INT = 1,
+    VT_REAL = 2
+};
+std::string varTypeEnumToString(VarTypes t);
+enum SymbolTypes {
+    ST_NUM = 0,
+    ST_ID = 1
+};
+int varTypeToSize(VarTypes t, size_t arraySize=0);